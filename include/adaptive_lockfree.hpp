@@ -0,0 +1,175 @@
+#pragma once
+#include "lockfree_wrapper.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+//LockFree object which chooses how writers update it: each writer copies and retries on conflict (COPY) or
+//writers queue their updates and one of them applies all queued updates to a single copy under a lock (COMBINE)
+//
+//readers are the same in both modes (lock free, immutable versions), only writers may block in COMBINE mode
+//
+//writers switch to COMBINE when the work lost by failed attempts (attempt time * failures per success) exceeds
+//the cost of a lock handover, i.e. for large objects under write contention, and back to COPY when
+//batches are (almost) single updates again, i.e. there is no contention to combine
+
+template <typename T, typename Alloc = Allocator>
+class AdaptiveLockFree
+{
+public:
+    enum Mode
+    {
+        COPY,
+        COMBINE
+    };
+
+    static constexpr uint64_t WINDOW{256}; //updates between decisions
+
+    template <typename... Args>
+    AdaptiveLockFree(Args &&... args) : object(std::forward<Args>(args)...)
+    {
+    }
+
+    AdaptiveLockFree(const AdaptiveLockFree &) = delete;
+    AdaptiveLockFree(AdaptiveLockFree &&) = delete;
+
+    typename LockFree<T, Alloc>::template ReadOnlyProxy<T> readOnly()
+    {
+        return object.readOnly();
+    }
+
+    //like LockFree::invoke (f may be called more than once, but with a fresh copy each time)
+    //returns the result by value (it is moved out of a local)
+    template <typename Function, typename... Params>
+    auto invoke(Function &&f, Params &&... params)
+    {
+        while (mode.load(std::memory_order_relaxed) == COPY)
+        {
+            auto start = std::chrono::steady_clock::now();
+            auto result = object.tryInvoke(f, params...);
+            countAttempt(std::chrono::steady_clock::now() - start, result.has_value());
+            if (result)
+            {
+                return std::move(*result);
+            }
+        }
+        return combine(f, params...);
+    }
+
+    Mode getMode() const
+    {
+        return mode.load(std::memory_order_relaxed);
+    }
+
+    //lost work per update above which writers combine their updates (about the cost of waking up a thread)
+    void setSwitchCost(std::chrono::nanoseconds cost)
+    {
+        switchCost.store(cost.count(), std::memory_order_relaxed);
+    }
+
+private:
+    struct Request
+    {
+        std::function<void(T *)> apply;
+        bool done{false}; //protected by combineMutex
+    };
+
+    LockFree<T, Alloc> object;
+    std::atomic<Mode> mode{COPY};
+    std::atomic<int64_t> switchCost{2000};
+
+    //COPY statistics of the current window
+    alignas(64) std::atomic<uint64_t> numAttempts{0};
+    std::atomic<uint64_t> numFailures{0};
+    std::atomic<int64_t> attemptNanoseconds{0};
+
+    //COMBINE
+    alignas(64) std::mutex queueMutex;
+    std::vector<Request *> queue;
+    std::mutex combineMutex; //held by the writer applying the queue
+    uint64_t numCombined{0};  //updates in the current window, protected by combineMutex
+    uint64_t numBatches{0};
+
+    void countAttempt(std::chrono::nanoseconds duration, bool succeeded)
+    {
+        attemptNanoseconds.fetch_add(duration.count(), std::memory_order_relaxed);
+        if (!succeeded)
+        {
+            numFailures.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (numAttempts.fetch_add(1, std::memory_order_relaxed) + 1 < WINDOW)
+        {
+            return;
+        }
+
+        //the thread completing the window decides (attempts of other threads may be counted in the next one)
+        numAttempts.store(0, std::memory_order_relaxed);
+        auto failures = numFailures.exchange(0, std::memory_order_relaxed);
+        auto nanoseconds = attemptNanoseconds.exchange(0, std::memory_order_relaxed);
+        auto successes = WINDOW > failures ? WINDOW - failures : 1;
+        auto lostPerUpdate = double(nanoseconds) / WINDOW * failures / successes;
+        if (lostPerUpdate > switchCost.load(std::memory_order_relaxed))
+        {
+            mode.store(COMBINE, std::memory_order_relaxed);
+        }
+    }
+
+    template <typename Function, typename... Params>
+    auto combine(Function &f, Params &... params)
+    {
+        std::optional<std::invoke_result_t<Function, T *, Params...>> result;
+        Request request{[&](T *copy) { result.emplace(std::invoke(f, copy, params...)); }};
+        {
+            std::lock_guard<std::mutex> g(queueMutex);
+            queue.push_back(&request);
+        }
+
+        std::lock_guard<std::mutex> g(combineMutex);
+        if (!request.done)
+        {
+            applyQueue();
+        }
+        return std::move(*result);
+    }
+
+    //all queued updates are applied to one copy (all together again if a COPY writer changed the object meanwhile)
+    void applyQueue()
+    {
+        std::vector<Request *> batch;
+        {
+            std::lock_guard<std::mutex> g(queueMutex);
+            batch.swap(queue);
+        }
+
+        object.invoke([&](T *copy) {
+            for (auto request : batch)
+            {
+                request->apply(copy);
+            }
+            return true;
+        });
+        for (auto request : batch)
+        {
+            request->done = true;
+        }
+
+        ++numBatches;
+        numCombined += batch.size();
+        if (numCombined >= WINDOW)
+        {
+            //hardly any writer waited for another one
+            if (numCombined < numBatches + numBatches / 4)
+            {
+                mode.store(COPY, std::memory_order_relaxed);
+            }
+            numCombined = 0;
+            numBatches = 0;
+        }
+    }
+};
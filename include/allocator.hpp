@@ -1,10 +1,13 @@
 #pragma once
 
 #include <utility>
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <mutex>
 #include <atomic>
+#include <memory>
+#include <memory_resource>
 
 //simple allocator
 class DefaultAllocator
@@ -62,15 +65,25 @@ public:
     template <typename T>
     static void free(T *p)
     {
+        if (untrack(p))
+        {
+            //outside of the lock, the destructor may free other objects
+            delete p;
+        }
+    }
 
+    //returns whether p was allocated and can be deleted
+    static bool untrack(void *p)
+    {
+        bool deletable = false;
         std::lock_guard<std::mutex> g(s_mutex);
         auto iter = s_allocations.find(p);
         if (iter != s_allocations.end())
         {
             if (iter->second >= 1)
             {
-                delete p;
-                //std::cout << "deallocated " << sizeof(T) << " bytes at " << p << std::endl;
+                deletable = true;
+                //std::cout << "deallocated " << p << std::endl;
                 iter->second--;
                 s_numAllocations--;
 
@@ -91,6 +104,7 @@ public:
             std::cout << "free error: " << p << " not allocated" << std::endl;
             s_errors++;
         }
+        return deletable;
     }
 
     static void
@@ -123,3 +137,90 @@ std::mutex MonitoredAllocator::s_mutex;
 std::map<void *, uint64_t> MonitoredAllocator::s_allocations{};
 uint64_t MonitoredAllocator::s_numAllocations{0};
 size_t MonitoredAllocator::s_errors{0};
+
+//allocates from a memory resource (e.g. one arena shared by several objects), the resource must outlive the allocator
+//unlike the allocators above this one is stateful, each LockFree object uses its own instance
+class PmrAllocator
+{
+public:
+    PmrAllocator(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) : resource(resource)
+    {
+    }
+
+    template <typename T, typename... Args>
+    T *allocate(Args &&... args)
+    {
+        auto memory = resource->allocate(sizeof(T), alignment<T>());
+        return new (memory) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    void free(T *p)
+    {
+        p->~T();
+        resource->deallocate(p, sizeof(T), alignment<T>());
+    }
+
+    void print()
+    {
+        std::cout << "PmrAllocator resource " << resource << std::endl;
+    }
+
+    std::pmr::memory_resource *resource;
+
+private:
+    //the low bit of a version pointer marks a multi update descriptor, hence versions are at least 2 byte aligned
+    //(a monotonic buffer hands out e.g. chars at any address)
+    template <typename T>
+    static constexpr size_t alignment()
+    {
+        return std::max<size_t>(alignof(T), 2);
+    }
+};
+
+//versions are recycled by a thread safe pool, which gets its memory from a monotonic buffer reserved upfront
+//(this keeps versions close to each other, the buffer grows if the reserved size is not sufficient)
+//default constructed instances share one arena, an object gets its own arena with ArenaAllocator(reservedSize)
+//(copies share the arena of the original)
+class ArenaAllocator : public PmrAllocator
+{
+public:
+    static constexpr size_t DEFAULT_RESERVED_SIZE{64 * 1024};
+
+    ArenaAllocator() : arena(shared())
+    {
+        resource = &arena->pool;
+    }
+
+    //a private arena
+    explicit ArenaAllocator(size_t reservedSize) : arena(std::make_shared<Arena>(reservedSize))
+    {
+        resource = &arena->pool;
+    }
+
+    void print()
+    {
+        std::cout << "ArenaAllocator pool " << resource << " reserved " << arena->reservedSize << " bytes" << std::endl;
+    }
+
+private:
+    struct Arena
+    {
+        Arena(size_t reservedSize) : reservedSize(reservedSize), buffer(reservedSize), pool(&buffer)
+        {
+        }
+
+        const size_t reservedSize;
+        std::pmr::monotonic_buffer_resource buffer; //only used by the pool (under its lock)
+        std::pmr::synchronized_pool_resource pool;
+    };
+
+    std::shared_ptr<Arena> arena;
+
+    //reserved on first use, kept alive by the allocators using it
+    static std::shared_ptr<Arena> shared()
+    {
+        static std::shared_ptr<Arena> s_arena(std::make_shared<Arena>(DEFAULT_RESERVED_SIZE));
+        return s_arena;
+    }
+};
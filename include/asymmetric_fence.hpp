@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+
+#if defined(LOCKFREE_ASYMMETRIC_FENCE) && defined(__linux__)
+#define LOCKFREE_MEMBARRIER
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//the fences between setting a hazard pointer and validating it against the current object (light, every reader)
+//and between replacing objects and reading the hazard pointers to delete them (heavy, only when scanning)
+//
+//with LOCKFREE_ASYMMETRIC_FENCE the light fence is only a compiler barrier and the heavy fence forces a memory barrier
+//on all running threads of the process instead (membarrier), if the kernel does not support this both are full fences
+
+class AsymmetricFence
+{
+public:
+    static void light()
+    {
+#ifdef LOCKFREE_MEMBARRIER
+        if (supported())
+        {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            return;
+        }
+#endif
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    static void heavy()
+    {
+#ifdef LOCKFREE_MEMBARRIER
+        if (supported())
+        {
+            syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+            return;
+        }
+#endif
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    static bool supported()
+    {
+#ifdef LOCKFREE_MEMBARRIER
+        //the process has to register once before it can use the expedited command
+        static const bool s_supported = syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+        return s_supported;
+#else
+        return false;
+#endif
+    }
+};
@@ -0,0 +1,186 @@
+#pragma once
+#include "lockfree_wrapper.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+//updates which give the thread back to an executor under contention instead of retrying in a loop
+//
+//an executor is any callable taking a std::function<void()>, which it runs later (e.g. posts it to a task queue),
+//after maxAttempts failed CAS the update is rescheduled through the executor and tries again with a fresh version
+//
+//with C++20 coroutines there are awaitable versions (coInvoke, waitForUpdate), otherwise the result is passed to a callback
+//
+//like invoke they take parameters for f, which are copied (the update may run later on another thread) and passed
+//to f as lvalues, the free functions make DEFAULT_ATTEMPTS attempts before rescheduling (construct the classes for others)
+//
+//waiting for an update does not poll, the writer which commits the next update hands the waiter to the executor
+
+template <typename T, typename Alloc, typename Policy, typename Executor, typename Function, typename... Params>
+class AsyncInvoke
+{
+public:
+    using Result = std::invoke_result_t<Function &, T *, Params &...>;
+
+    static constexpr uint32_t DEFAULT_ATTEMPTS{4};
+
+    AsyncInvoke(LockFree<T, Alloc, Policy> &wrapper, Executor executor, Function f, uint32_t maxAttempts, Params... params)
+        : wrapper(&wrapper), executor(std::move(executor)), f(std::move(f)), maxAttempts(maxAttempts), params(std::move(params)...)
+    {
+    }
+
+    //up to maxAttempts, the result is empty if all failed
+    std::optional<Result> attempt()
+    {
+        for (uint32_t i = 0; i < maxAttempts; ++i)
+        {
+            auto result = std::apply([&](auto &... params) { return wrapper->tryInvoke(f, params...); }, params);
+            if (result)
+            {
+                return result;
+            }
+        }
+        return std::nullopt;
+    }
+
+    //attempt now and reschedule until it succeeds, done(result) is called by the thread which succeeded
+    template <typename Done>
+    void run(Done done)
+    {
+        auto result = attempt();
+        if (result)
+        {
+            done(std::move(*result));
+            return;
+        }
+        auto self = *this;
+        executor([self, done]() mutable { self.run(std::move(done)); });
+    }
+
+protected:
+    LockFree<T, Alloc, Policy> *wrapper;
+    Executor executor;
+    Function f;
+    uint32_t maxAttempts;
+    std::tuple<Params...> params;
+};
+
+//like invoke(f, params...), the result is passed to done
+template <typename T, typename Alloc, typename Policy, typename Executor, typename Function, typename Done, typename... Params>
+void invokeAsync(LockFree<T, Alloc, Policy> &wrapper, Executor executor, Function f, Done done, Params &&... params)
+{
+    using Invoke = AsyncInvoke<T, Alloc, Policy, Executor, Function, std::decay_t<Params>...>;
+    Invoke(wrapper, std::move(executor), std::move(f), Invoke::DEFAULT_ATTEMPTS, std::forward<Params>(params)...).run(std::move(done));
+}
+
+//done(newVersion) once wrapper.version() differs from version, right away or run by the executor after the next update
+template <typename T, typename Alloc, typename Policy, typename Executor, typename Done>
+void waitForUpdateAsync(LockFree<T, Alloc, Policy> &wrapper, uint64_t version, Executor executor, Done done)
+{
+    auto current = wrapper.version();
+    if (current != version)
+    {
+        done(current);
+        return;
+    }
+    wrapper.onUpdate(version, [executor, done](uint64_t newVersion) mutable {
+        executor([done, newVersion]() mutable { done(newVersion); });
+    });
+}
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+
+//co_await coInvoke(wrapper, executor, f, params...), the coroutine is resumed by the executor if the first attempts fail
+template <typename T, typename Alloc, typename Policy, typename Executor, typename Function, typename... Params>
+class InvokeAwaitable : public AsyncInvoke<T, Alloc, Policy, Executor, Function, Params...>
+{
+    using Base = AsyncInvoke<T, Alloc, Policy, Executor, Function, Params...>;
+
+public:
+    using Base::Base;
+
+    bool await_ready()
+    {
+        result = this->attempt();
+        return result.has_value();
+    }
+
+    void await_suspend(std::coroutine_handle<> coroutine)
+    {
+        this->executor([this, coroutine]() {
+            result = this->attempt();
+            if (result)
+            {
+                coroutine.resume();
+                return;
+            }
+            await_suspend(coroutine);
+        });
+    }
+
+    typename Base::Result await_resume()
+    {
+        return std::move(*result);
+    }
+
+private:
+    std::optional<typename Base::Result> result;
+};
+
+template <typename T, typename Alloc, typename Policy, typename Executor, typename Function, typename... Params>
+InvokeAwaitable<T, Alloc, Policy, Executor, Function, std::decay_t<Params>...> coInvoke(LockFree<T, Alloc, Policy> &wrapper, Executor executor,
+                                                                                Function f, Params &&... params)
+{
+    using Awaitable = InvokeAwaitable<T, Alloc, Policy, Executor, Function, std::decay_t<Params>...>;
+    return Awaitable(wrapper, std::move(executor), std::move(f), Awaitable::DEFAULT_ATTEMPTS, std::forward<Params>(params)...);
+}
+
+//co_await waitForUpdate(wrapper, version, executor) returns the new version
+template <typename T, typename Alloc, typename Policy, typename Executor>
+class UpdateAwaitable
+{
+public:
+    UpdateAwaitable(LockFree<T, Alloc, Policy> &wrapper, uint64_t version, Executor executor)
+        : wrapper(wrapper), version(version), executor(std::move(executor))
+    {
+    }
+
+    bool await_ready()
+    {
+        current = wrapper.version();
+        return current != version;
+    }
+
+    //resumed by the executor after the next update
+    void await_suspend(std::coroutine_handle<> coroutine)
+    {
+        //with its own executor, the coroutine (and this awaitable) may be gone before the executor returns
+        wrapper.onUpdate(version, [this, coroutine, executor = executor](uint64_t newVersion) mutable {
+            current = newVersion;
+            executor([coroutine]() { coroutine.resume(); });
+        });
+    }
+
+    uint64_t await_resume()
+    {
+        return current;
+    }
+
+private:
+    LockFree<T, Alloc, Policy> &wrapper;
+    uint64_t version;
+    uint64_t current;
+    Executor executor;
+};
+
+template <typename T, typename Alloc, typename Policy, typename Executor>
+UpdateAwaitable<T, Alloc, Policy, Executor> waitForUpdate(LockFree<T, Alloc, Policy> &wrapper, uint64_t version, Executor executor)
+{
+    return UpdateAwaitable<T, Alloc, Policy, Executor>(wrapper, version, std::move(executor));
+}
+#endif
@@ -0,0 +1,414 @@
+#pragma once
+#include "hazard_domain.hpp"
+#include "lockfree_policies.hpp"
+#include "multi_update.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "assert.h"
+
+//the update protocol of LockFree objects and containers of copy on write cells: versions of T are published in
+//atomic pointers (cells), an update protects the current version with a hazard pointer, copies it, applies the
+//function to the copy and publishes it with a CAS, the replaced version is retired by the writer which replaced it
+//
+//allocator, hazard domain, commit hook, update counter, waiters and backpressure are shared by all cells of the owner
+//(LockFree has one cell, the containers have many), hence every owner offers them the same way
+
+template <typename T, typename Alloc, typename Policy>
+class CopyOnWrite
+{
+protected:
+    using HazardPointer = HazardDomain::HazardPointer;
+
+public:
+    //called by the writer after each successful update with the replaced and the new version (e.g. to update
+    //derived structures incrementally), both stay valid until it returns, only then the replaced one is retired
+    //hooks of concurrent writers run concurrently and not necessarily in commit order (a later update may be
+    //reported first), the hook has to synchronize itself and only combine changes that commute (e.g. add differences)
+    using CommitHook = std::function<void(const T *oldVersion, const T *newVersion)>;
+
+    //called once with the new version() after an update, on the thread of the writer which committed it (never on a
+    //reader or a thread helping a multi update), or by onUpdate if the version already changed
+    //(it delays the writer, hence it should only hand over, e.g. resume a coroutine on an executor)
+    using UpdateWaiter = std::function<void(uint64_t newVersion)>;
+
+    CopyOnWrite(const CopyOnWrite &) = delete;
+    CopyOnWrite(CopyOnWrite &&) = delete;
+
+    Alloc &getAllocator()
+    {
+        return allocator;
+    }
+
+    //number of updates so far, incremented after a new version was published
+    uint64_t version() const
+    {
+        return numUpdates.load(std::memory_order_acquire);
+    }
+
+    //set the hook before other threads use the object (or remove it with nullptr while no one updates it)
+    void onCommit(CommitHook hook)
+    {
+        commitHook = std::move(hook);
+    }
+
+    //waiter is called once version() differs from version (right away if it already does),
+    //waiters which are still waiting when the object is destroyed are never called
+    void onUpdate(uint64_t version, UpdateWaiter waiter)
+    {
+        {
+            std::lock_guard<std::mutex> g(waitersMutex);
+            waiters.emplace_back(version, std::move(waiter));
+            hasWaiters.store(true);
+        }
+        //either we see the update here or its writer sees the waiter (both sequentially consistent)
+        if (numUpdates.load() != version)
+        {
+            wakeWaiters();
+        }
+    }
+
+    //replaced versions which are not deallocated yet (still protected or not scanned yet)
+    uint64_t unreclaimed() const
+    {
+        return numUnreclaimed.load(std::memory_order_relaxed);
+    }
+
+    //without memory owned by the versions
+    uint64_t unreclaimedBytes() const
+    {
+        return unreclaimed() * sizeof(T);
+    }
+
+    //with more unreclaimed versions writers scan first, if that is not enough invoke (and multiInvoke) back off
+    //until readers release old versions and tryInvoke fails (0: no limit, default)
+    //concurrent writers may exceed it by one version each, proxies are not limited
+    //(a thread holding an old version itself must not invoke, it would wait for itself)
+    void setMaxUnreclaimed(uint64_t maxVersions)
+    {
+        maxUnreclaimed.store(maxVersions, std::memory_order_relaxed);
+    }
+
+protected:
+    Alloc allocator;
+    std::unique_ptr<HazardDomain> privateDomain; //only with PrivateReclamation
+    HazardDomain *domain;
+
+    CopyOnWrite(Alloc allocator, HazardDomain &domain)
+        : allocator(std::move(allocator)), domain(Policy::Reclamation::domain(domain, privateDomain))
+    {
+    }
+
+    //the owner deletes the current versions of its cells
+    ~CopyOnWrite()
+    {
+        domain->reclaim(this);
+    }
+
+    //like invoke, but only one attempt: the result is empty if the cell was changed concurrently
+    //(or if there are too many unreclaimed versions, see setMaxUnreclaimed)
+    template <typename Function, typename... Params>
+    auto tryInvoke(std::atomic<T *> &cell, Function &&f, Params &&... params)
+        -> std::optional<std::invoke_result_t<Function, T *, Params...>>
+    {
+        if (!reclaimBacklog())
+        {
+            return std::nullopt;
+        }
+
+        auto hp = acquire(cell);
+        T *expected = hp->template get<T>();
+        T *copy = allocate(*expected);
+
+        auto result = std::invoke(f, copy, std::forward<Params>(params)...);
+
+        if (publish(cell, hp, expected, copy, 1))
+        {
+            return result;
+        }
+        releaseHazardPointer(*hp);
+        return std::nullopt;
+    }
+
+    //todo: variant without return value, does not need to compute result internally
+    template <typename Function, typename... Params>
+    decltype(auto) invoke(std::atomic<T *> &cell, Function &&f, Params &&... params)
+    {
+        waitForBacklog();
+
+        uint64_t attempt = 0;
+        auto hp = acquire(cell);
+        do
+        {
+            ++attempt;
+            T *expected = hp->template get<T>();
+            T *copy = allocate(*expected); //local copy, protected against deletion by hp
+
+            auto result = std::invoke(f, copy, params...); //not forwarded, they are used again by the next attempt
+
+            if (publish(cell, hp, expected, copy, attempt))
+            {
+                return result;
+            }
+            hp = retry(cell, hp);
+        } while (true);
+    }
+
+    //like invoke, but only if condition(current version) holds, otherwise nothing is copied, published or counted
+    //returns whether update(copy) was published
+    template <typename Condition, typename Update>
+    bool invokeIf(std::atomic<T *> &cell, Condition &&condition, Update &&update)
+    {
+        waitForBacklog();
+
+        uint64_t attempt = 0;
+        auto hp = acquire(cell);
+        do
+        {
+            ++attempt;
+            T *expected = hp->template get<T>();
+            if (!condition(static_cast<const T &>(*expected)))
+            {
+                releaseHazardPointer(*hp);
+                return false;
+            }
+            T *copy = allocate(*expected);
+            update(copy);
+
+            if (publish(cell, hp, expected, copy, attempt))
+            {
+                return true;
+            }
+            hp = retry(cell, hp);
+        } while (true);
+    }
+
+    //after a failed attempt, returns the hazard pointer protecting the current version
+    //(hp protected expected, which was not retired by us, only its replacer retires it)
+    HazardPointer *retry(std::atomic<T *> &cell, HazardPointer *hp)
+    {
+        if constexpr (Policy::Recycling::recycle)
+        {
+            protect(cell, hp);
+            return hp;
+        }
+        else
+        {
+            releaseHazardPointer(*hp);
+            return acquire(cell);
+        }
+    }
+
+    //replace expected (protected by hp) with copy, on success hp is retired, otherwise copy is deallocated
+    //(and hp still protects expected)
+    bool publish(std::atomic<T *> &cell, HazardPointer *hp, T *expected, T *copy, uint64_t attempt)
+    {
+        auto copyHp = protectForHook(copy);
+        if (cell.compare_exchange_strong(expected, copy))
+        {
+            LOCKFREE_PROBE(CAS_SUCCESS, &cell, attempt);
+            committed(expected, copy, copyHp);
+            retireHazardPointer(*hp);
+            return true;
+        }
+        LOCKFREE_PROBE(CAS_FAILURE, &cell, attempt);
+
+        //our update failed, the copy is useless now
+        releaseForHook(copyHp);
+        deallocate(copy); //could optimize and use in place construction in memory instead
+        return false;
+    }
+
+    //the cell may temporarily hold a multi update descriptor, which we help to complete
+    //(only LockFree objects take part in multi updates, other cells never hold one)
+    static T *load(std::atomic<T *> &cell)
+    {
+        T *ptr = cell.load();
+        while (MultiUpdateDescriptor::isDescriptor(ptr))
+        {
+            MultiUpdateDescriptor::help(cell, ptr);
+            ptr = cell.load();
+        }
+        return ptr;
+    }
+
+    //protect the current version of cell with hp and return it
+    static T *protect(std::atomic<T *> &cell, HazardPointer *hp)
+    {
+        auto ptr = load(cell);
+        do
+        {
+            //the fence orders the store before the validating load, with asymmetric fences this is paid for in the scan
+            hp->ptr.store(ptr, std::memory_order_relaxed);
+            AsymmetricFence::light();
+            //is it still the same? needed, to ensure the hazard pointer is protected and no deletion in progress (when current object changes)
+            if (cell.load() == ptr)
+            {
+                break;
+            }
+            ptr = load(cell);
+        } while (true);
+        return ptr;
+    }
+
+    HazardPointer *acquire(std::atomic<T *> &cell)
+    {
+        auto hp = domain->acquire();
+        protect(cell, hp);
+        return hp;
+    }
+
+    //for readers, the hazard pointer must only be released (see HazardDomain::acquireForRead)
+    HazardPointer *acquireForRead(std::atomic<T *> &cell)
+    {
+        auto hp = domain->acquireForRead();
+        protect(cell, hp);
+        return hp;
+    }
+
+    void releaseHazardPointer(HazardPointer &hp)
+    {
+        domain->release(hp);
+    }
+
+    void retireHazardPointer(HazardPointer &hp)
+    {
+        numUnreclaimed.fetch_add(1, std::memory_order_relaxed);
+        domain->retire(hp, this, &reclaim);
+    }
+
+    template <typename... Args>
+    T *allocate(Args &&... args)
+    {
+        T *p = allocator.template allocate<T>(std::forward<Args>(args)...);
+        assert(!MultiUpdateDescriptor::isDescriptor(p) && "the allocator has to return at least 2 byte aligned versions");
+        return p;
+    }
+
+    void deallocate(T *p)
+    {
+        LOCKFREE_PROBE(DEALLOCATE, this, p);
+        allocator.free(p);
+    }
+
+    //false if there are still too many unreclaimed versions after we scanned
+    bool reclaimBacklog()
+    {
+        auto maxVersions = maxUnreclaimed.load(std::memory_order_relaxed);
+        if (maxVersions == 0 || numUnreclaimed.load(std::memory_order_relaxed) < maxVersions)
+        {
+            return true;
+        }
+        domain->scan();
+        if (numUnreclaimed.load(std::memory_order_relaxed) < maxVersions)
+        {
+            return true;
+        }
+        LOCKFREE_PROBE(THROTTLE, this, numUnreclaimed.load(std::memory_order_relaxed));
+        return false;
+    }
+
+    void waitForBacklog()
+    {
+        constexpr std::chrono::microseconds MAX_BACKOFF{1000};
+        for (std::chrono::microseconds backoff{1}; !reclaimBacklog(); backoff = std::min(backoff * 2, MAX_BACKOFF))
+        {
+            std::this_thread::sleep_for(backoff);
+        }
+    }
+
+    void countUpdate()
+    {
+        numUpdates.fetch_add(1);
+        if (hasWaiters.load())
+        {
+            wakeWaiters();
+        }
+    }
+
+    //a published version may be replaced and retired right away, hence the hook protects the new version
+    //before it is published (nothing without hook)
+    HazardPointer *protectForHook(T *version)
+    {
+        if (!commitHook)
+        {
+            return nullptr;
+        }
+        auto hp = domain->acquire();
+        hp->ptr.store(version);
+        return hp;
+    }
+
+    void releaseForHook(HazardPointer *hp)
+    {
+        if (hp)
+        {
+            releaseHazardPointer(*hp);
+        }
+    }
+
+    //after a successful update, the caller still protects oldVersion
+    void committed(T *oldVersion, T *newVersion, HazardPointer *newHp)
+    {
+        countUpdate();
+        notifyCommit(oldVersion, newVersion, newHp);
+    }
+
+    void notifyCommit(T *oldVersion, T *newVersion, HazardPointer *newHp)
+    {
+        if (newHp)
+        {
+            commitHook(oldVersion, newVersion);
+            releaseHazardPointer(*newHp);
+        }
+    }
+
+private:
+    std::atomic<uint64_t> numUpdates{0};
+    std::atomic<uint64_t> numUnreclaimed{0};
+    std::atomic<uint64_t> maxUnreclaimed{0};
+    CommitHook commitHook;
+    std::atomic<bool> hasWaiters{false}; //writers only take the lock if there are waiters
+    std::mutex waitersMutex;
+    std::vector<std::pair<uint64_t, UpdateWaiter>> waiters; //with the version they wait to change
+
+    static void reclaim(void *owner, void *ptr)
+    {
+        auto versions = static_cast<CopyOnWrite *>(owner);
+        versions->deallocate(static_cast<T *>(ptr));
+        versions->numUnreclaimed.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void wakeWaiters()
+    {
+        std::vector<UpdateWaiter> woken;
+        uint64_t current;
+        {
+            std::lock_guard<std::mutex> g(waitersMutex);
+            current = numUpdates.load();
+            //a waiter may have been added after the update we were woken for (still waiting for the next one)
+            auto waiting = std::partition(waiters.begin(), waiters.end(), [&](auto &waiter) { return waiter.first == current; });
+            for (auto iter = waiting; iter != waiters.end(); ++iter)
+            {
+                woken.push_back(std::move(iter->second));
+            }
+            waiters.erase(waiting, waiters.end());
+            hasWaiters.store(!waiters.empty());
+        }
+        for (auto &waiter : woken)
+        {
+            waiter(current);
+        }
+    }
+};
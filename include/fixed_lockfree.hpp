@@ -0,0 +1,241 @@
+#pragma once
+#include "asymmetric_fence.hpp"
+#include "trace.hpp"
+#include "version_state.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <thread>
+#include <utility>
+
+//LockFree object without any allocation after construction (e.g. for real time loops): the hazard slots and all
+//versions are stored in the object itself, with capacity for MaxThreads threads using the object at the same time
+//
+//every thread protects at most one version and writes at most one copy, hence with the current version
+//2 * MaxThreads + 1 versions are the worst case and there is always a free version after reclaiming
+//(reading and updating never fail, with more than MaxThreads threads some of them wait for a free slot)
+//
+//versions are constructed and destroyed in place, T itself should not allocate when it is copied
+
+template <typename T, uint32_t MaxThreads>
+class FixedLockFree
+{
+    static constexpr uint32_t MAX_VERSIONS{2 * MaxThreads + 1};
+    static constexpr uint32_t NONE{~0u};
+
+    struct alignas(64) Slot
+    {
+        std::atomic<bool> used{false};
+        std::atomic<uint32_t> hazard{NONE}; //index of the protected version
+    };
+
+    struct alignas(64) Version
+    {
+        std::atomic<uint64_t> state{VersionState::FREE};
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T *object()
+        {
+            return std::launder(reinterpret_cast<T *>(storage));
+        }
+    };
+
+public:
+    class ReadOnlyProxy
+    {
+    public:
+        friend class FixedLockFree;
+
+        ~ReadOnlyProxy()
+        {
+            owner->releaseSlot(slot);
+        }
+
+        const T *operator->()
+        {
+            return object;
+        }
+
+        const T &operator*()
+        {
+            return *object;
+        }
+
+    private:
+        FixedLockFree *owner;
+        uint32_t slot;
+        const T *object;
+
+        ReadOnlyProxy(FixedLockFree *owner, uint32_t slot, const T *object) : owner(owner), slot(slot), object(object)
+        {
+        }
+    };
+
+    template <typename... Args>
+    FixedLockFree(Args &&... args)
+    {
+        new (versions[0].storage) T(std::forward<Args>(args)...);
+        versions[0].state.store(VersionState::PUBLISHED, std::memory_order_relaxed);
+        current.store(0);
+    }
+
+    //no one may use the object anymore
+    ~FixedLockFree()
+    {
+        for (auto &version : versions)
+        {
+            if (VersionState::kind(version.state.load()) != VersionState::FREE)
+            {
+                version.object()->~T();
+            }
+        }
+    }
+
+    FixedLockFree(const FixedLockFree &) = delete;
+    FixedLockFree(FixedLockFree &&) = delete;
+
+    static constexpr uint32_t capacity()
+    {
+        return MAX_VERSIONS;
+    }
+
+    ReadOnlyProxy readOnly()
+    {
+        auto slot = acquireSlot();
+        auto index = protect(slot);
+        return ReadOnlyProxy(this, slot, versions[index].object());
+    }
+
+    //like LockFree::invoke, the copy is constructed in a free version
+    template <typename Function, typename... Params>
+    decltype(auto) invoke(Function &&f, Params &&... params)
+    {
+        uint64_t attempt = 0;
+        auto slot = acquireSlot();
+        do
+        {
+            ++attempt;
+            auto index = protect(slot);
+            uint64_t writing;
+            auto copyIndex = allocateVersion(writing);
+            auto copy = new (versions[copyIndex].storage) T(*versions[index].object());
+
+            auto result = std::invoke(f, copy, params...);
+
+            if (current.compare_exchange_strong(index, copyIndex))
+            {
+                LOCKFREE_PROBE(CAS_SUCCESS, this, attempt);
+                //the copy may already be replaced and retired, the replaced version is protected by slot
+                VersionState::publish(versions[copyIndex].state, writing);
+                VersionState::retire(versions[index].state);
+                releaseSlot(slot);
+                return result;
+            }
+            LOCKFREE_PROBE(CAS_FAILURE, this, attempt);
+
+            copy->~T();
+            VersionState::abandon(versions[copyIndex].state, writing);
+        } while (true);
+    }
+
+private:
+    alignas(64) std::atomic<uint32_t> current; //index of the current version
+    Slot slots[MaxThreads];
+    Version versions[MAX_VERSIONS];
+
+    uint32_t acquireSlot()
+    {
+        thread_local uint32_t t_hint{0}; //usually the slot of this thread is free again
+        do
+        {
+            for (uint32_t i = 0; i < MaxThreads; ++i)
+            {
+                auto index = (t_hint + i) % MaxThreads;
+                bool expected = false;
+                if (!slots[index].used.load(std::memory_order_relaxed) && slots[index].used.compare_exchange_strong(expected, true))
+                {
+                    t_hint = index;
+                    return index;
+                }
+            }
+            std::this_thread::yield(); //more than MaxThreads threads
+        } while (true);
+    }
+
+    void releaseSlot(uint32_t slot)
+    {
+        slots[slot].hazard.store(NONE, std::memory_order_release);
+        slots[slot].used.store(false, std::memory_order_release);
+    }
+
+    //the index of the current version, protected by slot
+    uint32_t protect(uint32_t slot)
+    {
+        auto &hazard = slots[slot].hazard;
+        auto index = current.load();
+        do
+        {
+            hazard.store(index, std::memory_order_relaxed);
+            AsymmetricFence::light();
+            auto currentIndex = current.load();
+            if (currentIndex == index)
+            {
+                return index;
+            }
+            index = currentIndex;
+        } while (true);
+    }
+
+    uint32_t allocateVersion(uint64_t &writing)
+    {
+        do
+        {
+            for (auto &version : versions)
+            {
+                writing = VersionState::tryAllocate(version.state);
+                if (writing)
+                {
+                    return &version - versions;
+                }
+            }
+            reclaim();
+        } while (true);
+    }
+
+    //destroy all retired versions which are not protected anymore
+    void reclaim()
+    {
+        //candidates first, a version retired later may be protected by a slot we already checked
+        bool candidate[MAX_VERSIONS];
+        uint64_t retired[MAX_VERSIONS];
+        for (uint32_t index = 0; index < MAX_VERSIONS; ++index)
+        {
+            retired[index] = versions[index].state.load();
+            candidate[index] = VersionState::kind(retired[index]) == VersionState::RETIRED;
+        }
+        AsymmetricFence::heavy();
+        for (auto &slot : slots)
+        {
+            auto index = slot.hazard.load();
+            if (index < MAX_VERSIONS)
+            {
+                candidate[index] = false;
+            }
+        }
+        for (uint32_t index = 0; index < MAX_VERSIONS; ++index)
+        {
+            if (!candidate[index])
+            {
+                continue;
+            }
+            if (auto claimed = VersionState::tryClaim(versions[index].state, retired[index]))
+            {
+                //exclusively ours now
+                versions[index].object()->~T();
+                VersionState::release(versions[index].state, claimed);
+            }
+        }
+    }
+};
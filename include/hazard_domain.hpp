@@ -0,0 +1,879 @@
+#pragma once
+#include "asymmetric_fence.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "assert.h"
+
+//hazard pointers and reclamation shared by many LockFree objects (of possibly different types)
+//a hazard pointer is only used by one thread at a time, hence the number of hazard pointers scales with the number
+//of threads (and the objects they use concurrently) and not with the number of objects, scans are shared as well
+//
+//objects use the global domain by default, e.g. the objects of a subsystem can use their own domain instead
+//(smaller scans, but threads using objects of several domains need hazard pointers in each of them)
+
+class HazardDomain
+{
+public:
+    enum Status
+    {
+        FREE,             //the hazard pointer can be acquired and its pointer set
+        USED,             //the hazard pointer is in use and protecting what ptr points to
+        RELEASED,         //the hazard pointer was released after its protected ptr was replaced, but ptr not cleaned up (which might not be possible if there are other users)
+        DELETE_CANDIDATE, //the hazard pointer was released and one instance of its protected ptr can be deleted
+        READY_TO_DELETE,  //the hazard pointer was released and this specific ptr instance can be deleted
+        REMOVED,          //the hazard pointer was unlinked from the list and waits to be reused
+        OWNED             //the hazard pointer belongs to a thread for reading, it protects ptr (if any) like a used one
+    };
+
+    //deletes ptr, which belongs to owner (only the owner knows its type and allocator)
+    using Reclaim = void (*)(void *owner, void *ptr);
+
+    //called by the scanning thread after each scan with its duration (including waiting for a concurrent scan)
+    using ScanObserver = void (*)(std::chrono::nanoseconds duration);
+
+    //one cache line each, they are written by different threads
+    struct alignas(64) HazardPointer
+    {
+        HazardPointer(uint64_t id = 0) : id(id)
+        {
+        }
+
+        template <typename T>
+        T *get()
+        {
+            return static_cast<T *>(ptr.load());
+        }
+
+        void print()
+        {
+            std::cout << "HP " << id << " " << this << " ptr " << ptr.load() << " " << statusStr() << std::endl;
+        }
+
+        std::string statusStr()
+        {
+            switch (status)
+            {
+            case FREE:
+                return "FREE";
+            case USED:
+                return "USED";
+            case RELEASED:
+                return "RELEASED";
+            case DELETE_CANDIDATE:
+                return "DELETE_CANDIDATE";
+            case READY_TO_DELETE:
+                return "READY_TO_DELETE";
+            case REMOVED:
+                return "REMOVED";
+            case OWNED:
+                return "OWNED";
+            }
+            return "";
+        }
+
+        bool updateStatus(uint32_t expected, uint32_t desired)
+        {
+            uint32_t oldStatus = expected;
+            do
+            {
+                if (status.compare_exchange_weak(oldStatus, desired))
+                {
+                    return true;
+                }
+            } while (oldStatus == expected);
+            return false;
+        }
+
+        std::atomic<void *> ptr{nullptr}; //the payload we want to protect
+        std::atomic<HazardPointer *> next{nullptr}; //written while linked only by compact (under deleteMutex)
+        std::atomic<uint32_t> status{FREE};
+        std::atomic<bool> taken{false}; //only OWNED: held by a reader (set by the owner, cleared by the releaser)
+        const uint64_t id; //unique and does not change
+
+        //set when retired, before the status (only read by scans of RELEASED or later hazard pointers)
+        void *owner{nullptr};
+        Reclaim reclaim{nullptr};
+    };
+
+    //a limit against leaking hazard pointers, every hazard pointer held at the same time by any object of the domain
+    //(proxies, reader handles, retired versions not yet reclaimed) counts, hence it is large by default
+    static constexpr uint64_t DEFAULT_MAX_HAZARD_POINTERS{1 << 16};
+
+    //hazard pointers are allocated from resource (e.g. a HugePageResource), it must outlive the domain
+    //at most maxHazardPointers are created, acquire waits (scanning) for a free one once all of them are held
+    explicit HazardDomain(std::pmr::memory_resource *resource = std::pmr::new_delete_resource(),
+                          uint64_t maxHazardPointers = DEFAULT_MAX_HAZARD_POINTERS)
+        : resource(resource), maxHazardPointers(maxHazardPointers), id(s_nextId.fetch_add(1, std::memory_order_relaxed))
+    {
+    }
+
+    //all objects using the domain must be destroyed before (threads still running may outlive it)
+    ~HazardDomain()
+    {
+        auto hp = hazardPointers.load();
+        while (hp)
+        {
+            auto next = hp->next.load();
+            destroyHazardPointer(hp);
+            hp = next;
+        }
+        for (auto removedHp : removed)
+        {
+            destroyHazardPointer(removedHp);
+        }
+    }
+
+    HazardDomain(const HazardDomain &) = delete;
+    HazardDomain(HazardDomain &&) = delete;
+
+    //used by all objects which are not constructed with a domain
+    static HazardDomain &global()
+    {
+        static HazardDomain s_domain;
+        return s_domain;
+    }
+
+    //get a free hazard pointer or create a new one, the caller sets ptr and validates it
+    HazardPointer *acquire()
+    {
+        //usually the one we used last is free again, then we do not touch the hazard pointers of other threads
+        auto &local = localState();
+        auto hint = local.hint.load(std::memory_order_relaxed);
+        uint32_t expectedStatus = FREE;
+        if (hint && hint->status.compare_exchange_strong(expectedStatus, USED))
+        {
+            LOCKFREE_PROBE(ACQUIRE, this, hint);
+            return hint;
+        }
+
+        //we spin until a free one becomes available if creation is impossible
+        HazardPointer *hp;
+        do
+        {
+            hp = hazardPointers.load();
+            //try to recycle a free hazard pointer
+            while (hp)
+            {
+                expectedStatus = FREE;
+                if (hp->status.compare_exchange_strong(expectedStatus, USED))
+                {
+                    local.hint.store(hp, std::memory_order_relaxed);
+                    LOCKFREE_PROBE(ACQUIRE, this, hp);
+                    return hp;
+                }
+                hp = hp->next;
+            }
+
+            //no free hazard pointer, create a new one (or insert an unlinked one again)
+            hp = createHazardPointer();
+            if (hp)
+            {
+                break;
+            }
+            //all are used or retired, the latter may be reclaimable now
+            scan();
+        } while (true);
+
+        hp->status.store(USED);
+
+        auto head = hazardPointers.load();
+        do
+        {
+            hp->next.store(head);
+        } while (!hazardPointers.compare_exchange_weak(head, hp));
+        numListed.fetch_add(1);
+
+        local.hint.store(hp, std::memory_order_relaxed);
+        LOCKFREE_PROBE(CREATE, this, hp->id);
+        LOCKFREE_PROBE(ACQUIRE, this, hp);
+        return hp;
+    }
+
+    //like acquire, but the hazard pointer may only be released and never retired (i.e. only to read)
+    //a thread with its own state owns one hazard pointer for this, it takes it with plain stores only
+    //(no read-modify-write, hence with asymmetric fences a read costs no locked instruction), nested reads
+    //and threads sharing a state acquire as usual
+    HazardPointer *acquireForRead()
+    {
+        bool exclusive;
+        auto &local = localState(exclusive);
+        if (!exclusive)
+        {
+            return acquire();
+        }
+
+        //only this thread takes it, others may only release it (e.g. a proxy handed over to another thread)
+        auto owned = local.owned.load(std::memory_order_relaxed);
+        if (owned && !owned->taken.load(std::memory_order_acquire))
+        {
+            owned->taken.store(true, std::memory_order_relaxed);
+            LOCKFREE_PROBE(ACQUIRE, this, owned);
+            return owned;
+        }
+
+        auto hp = acquire();
+        if (!owned)
+        {
+            //owned before the status says so, compact only frees owned hazard pointers of no thread
+            hp->taken.store(true, std::memory_order_relaxed);
+            local.owned.store(hp);
+            hp->status.store(OWNED);
+        }
+        return hp;
+    }
+
+    //expect that it is a used (or owned) hazard pointer
+    void release(HazardPointer &hp)
+    {
+        //an owned one stays with its thread, it only stops protecting
+        if (hp.status.load(std::memory_order_relaxed) == OWNED)
+        {
+            hp.ptr.store(nullptr, std::memory_order_release);
+            hp.taken.store(false, std::memory_order_release);
+            return;
+        }
+        //we are the only writer to this hazard pointer (hence no compare exchange needed)
+        hp.status.store(FREE);
+    }
+
+    //release a used hazard pointer whose protected object we replaced, i.e. which has to be deleted once no one uses it anymore
+    //(exactly one hazard pointer is retired per replaced object, namely by the one who replaced it)
+    void retire(HazardPointer &hp, void *owner, Reclaim reclaim)
+    {
+        assert(hp.status.load(std::memory_order_relaxed) != OWNED && "hazard pointers acquired for reading cannot be retired");
+        hp.owner = owner;
+        hp.reclaim = reclaim;
+        hp.status.store(RELEASED);
+
+        //every thread scans after it retired a batch of objects, the counter is (usually) only written by this thread
+        //(the retired objects occupy hazard pointers, a batch relative to their number would let it grow without bound)
+        //(if threads exited, we scan for the objects they retired since their last scan and compact the list)
+        //(with incremental scans, every retire advances the scan by a bounded amount of work instead)
+        auto maxWork = scanWork.load(std::memory_order_relaxed);
+        if (maxWork > 0)
+        {
+            scanStep(maxWork);
+            return;
+        }
+
+        constexpr uint64_t scanBatchSize = 8;
+        auto &local = localState();
+        auto numReleased = local.numReleased.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (numReleased >= scanBatchSize || threadStates->numExited.load(std::memory_order_relaxed) > 0)
+        {
+            local.numReleased.store(0, std::memory_order_relaxed);
+            scan();
+        }
+    }
+
+    //delete all retired objects which are not protected anymore
+    void scan()
+    {
+        auto observer = scanObserver.load(std::memory_order_relaxed);
+        if (observer)
+        {
+            auto start = std::chrono::steady_clock::now();
+            scanAndDelete();
+            observer(std::chrono::steady_clock::now() - start);
+            return;
+        }
+        scanAndDelete();
+    }
+
+    //e.g. to measure the latency of scans (nullptr to stop), with incremental scans the latency of each step
+    void observeScans(ScanObserver observer)
+    {
+        scanObserver.store(observer);
+    }
+
+    //retire does at most maxWork units of a scan (visiting a hazard pointer, checking a candidate or deleting
+    //an object), the scan continues where it stopped at the next retire
+    //a retired object costs about 4 units (visited twice, checked, deleted), with less the retired objects pile up
+    //0 (default): every batch of retires of a thread triggers a complete scan
+    //(scan and reclaim are always complete, e.g. acquire scans completely if no hazard pointer can be created)
+    void setIncrementalScan(uint32_t maxWork)
+    {
+        scanWork.store(maxWork, std::memory_order_relaxed);
+    }
+
+    //delete all retired objects of owner, no one may use the owner anymore (called when it is destroyed)
+    //afterwards no hazard pointer refers to the owner
+    void reclaim(void *owner)
+    {
+        std::lock_guard<std::recursive_mutex> g(deleteMutex);
+        scan();
+
+        //only objects of other owners can still be protected (and they cannot have the same address as ours)
+        auto hp = hazardPointers.load();
+        while (hp)
+        {
+            uint32_t status = hp->status.load();
+            if ((status == RELEASED || status == DELETE_CANDIDATE || status == READY_TO_DELETE) && hp->owner == owner)
+            {
+                hp->status.store(READY_TO_DELETE);
+            }
+            hp = hp->next;
+        }
+        tryDelete();
+    }
+
+    //in the list, i.e. walked by scans (unlinked ones of exited threads are not counted)
+    uint64_t numHazardPointers() const
+    {
+        return numListed.load();
+    }
+
+    //e.g. for the global domain, which is constructed on first use (lowering it does not destroy created ones)
+    void setMaxHazardPointers(uint64_t maxNum)
+    {
+        maxHazardPointers.store(maxNum);
+    }
+
+    uint64_t getMaxHazardPointers() const
+    {
+        return maxHazardPointers.load();
+    }
+
+    void print()
+    {
+        std::cout << "****************" << std::endl;
+        auto hp = hazardPointers.load();
+        while (hp)
+        {
+            hp->print();
+            hp = hp->next;
+        }
+        std::cout << "****************" << std::endl;
+    }
+
+private:
+    std::pmr::memory_resource *resource;
+    std::atomic<uint64_t> maxHazardPointers;
+
+    //hazardpointers are only destroyed when the domain goes out of scope (to make dealing with some ABA issues easier)
+    //free ones of exited threads are unlinked by compact, but kept for reuse since acquire may still walk through them
+    //this is also not the best structure to search in, there is potential for optimization
+    //but it shows the general idea
+
+    std::atomic<uint64_t> numHazardPointersCreated{0}; //never more than maxHazardPointers (unless it was lowered)
+    std::atomic<uint64_t> numListed{0}; //i.e. list size
+    std::atomic<HazardPointer *> hazardPointers{nullptr}; //managed hazard pointers, can be used to protect objects
+
+    std::mutex removedMutex; //only taken to create a hazard pointer (and by compact)
+    std::vector<HazardPointer *> removed;
+
+    //per thread state in the domain, a thread claims a state when it first uses the domain and returns it when it exits
+    //(threads share a state if there are more threads)
+    //readers and writers only write to their own state and hazard pointer, i.e. no cache line shared with other threads
+    struct alignas(64) ThreadState
+    {
+        std::atomic<HazardPointer *> hint{nullptr};  //last hazard pointer acquired
+        std::atomic<HazardPointer *> owned{nullptr}; //for reading, only of the thread which claimed the state first
+        std::atomic<uint64_t> numReleased{0};        //retired since the last scan of this thread
+        std::atomic<uint32_t> numThreads{0};         //using this state
+    };
+
+    static constexpr uint32_t MAX_THREAD_STATES{64};
+
+    //shared with the threads which claimed a state, they may exit after the domain was destroyed
+    struct ThreadStates
+    {
+        ThreadState states[MAX_THREAD_STATES];
+        std::atomic<uint32_t> nextShared{0};
+        alignas(64) std::atomic<uint64_t> numExited{0}; //threads which returned their state since the last scan
+    };
+
+    //the states a thread claimed (in domains of any ids), returned by the thread exit
+    struct ThreadRegistry
+    {
+        struct Entry
+        {
+            uint64_t domainId;
+            std::weak_ptr<ThreadStates> states;
+            ThreadState *state;
+            bool exclusive; //claimed the state first (other threads may share it later)
+        };
+        std::vector<Entry> entries;
+
+        ~ThreadRegistry()
+        {
+            for (auto &entry : entries)
+            {
+                if (auto states = entry.states.lock())
+                {
+                    returnState(*states, *entry.state, entry.exclusive);
+                }
+            }
+        }
+    };
+
+    static inline std::atomic<uint64_t> s_nextId{0};
+    const uint64_t id; //unlike the address, never used by another domain
+    std::shared_ptr<ThreadStates> threadStates{std::make_shared<ThreadStates>()};
+
+    ThreadState &localState()
+    {
+        bool exclusive;
+        return localState(exclusive);
+    }
+
+    ThreadState &localState(bool &exclusive)
+    {
+        //usually the thread uses the same domain as last time
+        thread_local uint64_t t_lastDomain{~0ull};
+        thread_local ThreadState *t_lastState{nullptr};
+        thread_local bool t_lastExclusive{false};
+        if (t_lastDomain == id)
+        {
+            exclusive = t_lastExclusive;
+            return *t_lastState;
+        }
+
+        thread_local ThreadRegistry t_registry;
+        auto &entries = t_registry.entries;
+        auto entry = std::find_if(entries.begin(), entries.end(), [this](auto &entry) { return entry.domainId == id; });
+        if (entry == entries.end())
+        {
+            //forget the domains which were destroyed meanwhile
+            entries.erase(std::remove_if(entries.begin(), entries.end(), [](auto &entry) { return entry.states.expired(); }), entries.end());
+            bool claimedExclusive;
+            auto &state = claimState(claimedExclusive);
+            entries.push_back({id, threadStates, &state, claimedExclusive});
+            entry = entries.end() - 1;
+        }
+        t_lastDomain = id;
+        t_lastState = entry->state;
+        t_lastExclusive = entry->exclusive;
+        exclusive = t_lastExclusive;
+        return *t_lastState;
+    }
+
+    ThreadState &claimState(bool &exclusive)
+    {
+        auto &states = threadStates->states;
+        exclusive = true;
+        for (auto &state : states)
+        {
+            uint32_t expected = 0;
+            if (state.numThreads.load(std::memory_order_relaxed) == 0 && state.numThreads.compare_exchange_strong(expected, 1))
+            {
+                return state;
+            }
+        }
+        exclusive = false;
+        auto &state = states[threadStates->nextShared.fetch_add(1, std::memory_order_relaxed) % MAX_THREAD_STATES];
+        state.numThreads.fetch_add(1);
+        return state;
+    }
+
+    //the objects the thread retired since its last scan are left to the next thread which retires one (see retire)
+    //its owned hazard pointer is freed by compact
+    static void returnState(ThreadStates &states, ThreadState &state, bool exclusive)
+    {
+        if (exclusive)
+        {
+            state.owned.store(nullptr);
+        }
+        if (state.numThreads.load() == 1)
+        {
+            //its hint may be unlinked now, a thread claiming the state later acquires another one
+            state.hint.store(nullptr, std::memory_order_relaxed);
+            state.numReleased.store(0, std::memory_order_relaxed);
+        }
+        state.numThreads.fetch_sub(1);
+        states.numExited.fetch_add(1);
+    }
+
+    std::atomic<ScanObserver> scanObserver{nullptr};
+
+    //recursive: deleting an object may destroy other objects of the domain, which reclaim their retired objects
+    std::recursive_mutex deleteMutex;
+
+    //buffers of the scan, reused to avoid allocations (protected by deleteMutex, a nested scan only starts in tryDelete)
+    struct Candidate
+    {
+        void *ptr;
+        HazardPointer *hp;
+    };
+    std::vector<Candidate> candidates;
+    std::vector<void *> usedPointers;
+
+    //the phases of scanAndDelete spread over several steps (protected by deleteMutex)
+    //a complete scan in between aborts the incremental one, it may have changed the candidates (and uses the buffers)
+    enum ScanPhase
+    {
+        IDLE,
+        CANDIDATES,
+        USED_POINTERS,
+        MARK,
+        DELETE
+    };
+
+    struct IncrementalScan
+    {
+        ScanPhase phase{IDLE};
+        HazardPointer *cursor{nullptr}; //next in the list (CANDIDATES, USED_POINTERS)
+        size_t index{0};                //next candidate (MARK, DELETE)
+        void *deleted{nullptr};
+        size_t numDeleted{0};
+        uint64_t numAborted{0};
+        bool running{false}; //deleting an object may retire others, whose retire must not step in between
+    };
+
+    std::atomic<uint32_t> scanWork{0};
+    IncrementalScan incremental;
+
+    static constexpr size_t LINEAR_SEARCH{64}; //up to this many used pointers a (vectorized) linear search is faster
+
+    bool isUsed(void *ptr) const
+    {
+        if (usedPointers.size() <= LINEAR_SEARCH)
+        {
+            //no early exit, the compiler can vectorize the comparisons
+            bool used = false;
+            for (auto usedPtr : usedPointers)
+            {
+                used |= usedPtr == ptr;
+            }
+            return used;
+        }
+        return std::binary_search(usedPointers.begin(), usedPointers.end(), ptr);
+    }
+
+    void scanAndDelete()
+    {
+        std::lock_guard<std::recursive_mutex> g(deleteMutex);
+        LOCKFREE_PROBE(SCAN_START, this, numListed.load(std::memory_order_relaxed));
+        if (incremental.phase != IDLE)
+        {
+            incremental.phase = IDLE;
+            ++incremental.numAborted;
+        }
+        candidates.clear();
+        usedPointers.clear();
+
+        //we can iterate over the hazard pointer list without problems (there may be added new ones in front,
+        //but they are just not considered for deletion and at least as new as the current objects
+
+        //the candidates are collected first: their objects were replaced before, hence anyone still protecting them
+        //has set the hazard pointer before and we will see it in the second pass
+        //(in a single pass we could miss a hazard pointer set after we passed it but before the object was replaced)
+        {
+            auto hp = hazardPointers.load();
+            while (hp)
+            {
+                uint32_t status = hp->status.load(); //this can be outdated but it does not matter
+                if (status == RELEASED || status == DELETE_CANDIDATE || status == READY_TO_DELETE)
+                {
+                    candidates.push_back({nullptr, hp});
+                }
+                hp = hp->next;
+            }
+        }
+
+        //make the hazard pointers of readers visible (they only fence lightly if asymmetric fences are used)
+        AsymmetricFence::heavy();
+
+        {
+            auto hp = hazardPointers.load();
+            while (hp)
+            {
+                uint32_t status = hp->status.load(); //note that it does not matter if the status changed inbetween (we just cannot free it in this scan)
+                if (status == USED || status == OWNED)
+                {
+                    usedPointers.push_back(hp->ptr.load());
+                }
+                hp = hp->next;
+            }
+        }
+        if (usedPointers.size() > LINEAR_SEARCH)
+        {
+            std::sort(usedPointers.begin(), usedPointers.end());
+        }
+
+        //sorted by pointer, hazard pointers retiring the same object are adjacent
+        for (auto &candidate : candidates)
+        {
+            candidate.ptr = candidate.hp->ptr.load();
+        }
+        std::sort(candidates.begin(), candidates.end(), [](auto &a, auto &b) { return a.ptr < b.ptr; });
+
+        //now check if we really can delete the candidates (i.e. no USED hazardpointer with the same ptr exists),
+        //only the first hazard pointer of an object deletes it, further ones may be marked as free
+        size_t numDeleted = 0;
+        void *deleted = nullptr;
+        for (auto &candidate : candidates)
+        {
+            mark(candidate, deleted, numDeleted);
+        }
+
+        LOCKFREE_PROBE(SCAN_END, candidates.size(), numDeleted);
+
+        //still under the lock, otherwise a concurrent scan could observe a hazard pointer recycled in between
+        tryDelete();
+
+        compactIfThreadsExited();
+    }
+
+    void mark(const Candidate &candidate, void *&deleted, size_t &numDeleted)
+    {
+        if (isUsed(candidate.ptr))
+        {
+            return;
+        }
+        auto hp = candidate.hp;
+        hp->updateStatus(RELEASED, DELETE_CANDIDATE);
+        if (numDeleted == 0 || candidate.ptr != deleted)
+        {
+            if (hp->updateStatus(DELETE_CANDIDATE, READY_TO_DELETE))
+            {
+                deleted = candidate.ptr;
+                ++numDeleted;
+            }
+        }
+        else
+        {
+            hp->updateStatus(DELETE_CANDIDATE, FREE);
+        }
+    }
+
+    //at most maxWork units of the current incremental scan (or a new one)
+    //(a thread waits for a concurrent step instead of skipping its own, the work would be lost otherwise)
+    void scanStep(uint32_t maxWork)
+    {
+        std::lock_guard<std::recursive_mutex> g(deleteMutex);
+        if (incremental.running)
+        {
+            return;
+        }
+        incremental.running = true;
+        auto observer = scanObserver.load(std::memory_order_relaxed);
+        auto start = observer ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+        auto numAborted = incremental.numAborted;
+        uint32_t work = 0;
+        while (work < maxWork && incremental.numAborted == numAborted)
+        {
+            auto &hp = incremental.cursor;
+            switch (incremental.phase)
+            {
+            case IDLE:
+                LOCKFREE_PROBE(SCAN_START, this, numListed.load(std::memory_order_relaxed));
+                candidates.clear();
+                usedPointers.clear();
+                hp = hazardPointers.load();
+                incremental.phase = CANDIDATES;
+                break;
+
+            case CANDIDATES:
+                if (!hp)
+                {
+                    AsymmetricFence::heavy();
+                    hp = hazardPointers.load();
+                    incremental.phase = USED_POINTERS;
+                    break;
+                }
+                {
+                    //the ptr of a retired hazard pointer does not change until a scan frees it
+                    uint32_t status = hp->status.load();
+                    if (status == RELEASED || status == DELETE_CANDIDATE || status == READY_TO_DELETE)
+                    {
+                        candidates.push_back({hp->ptr.load(), hp});
+                    }
+                }
+                hp = hp->next;
+                ++work;
+                break;
+
+            case USED_POINTERS:
+                if (!hp)
+                {
+                    if (usedPointers.size() > LINEAR_SEARCH)
+                    {
+                        std::sort(usedPointers.begin(), usedPointers.end());
+                    }
+                    std::sort(candidates.begin(), candidates.end(), [](auto &a, auto &b) { return a.ptr < b.ptr; });
+                    incremental.index = 0;
+                    incremental.deleted = nullptr;
+                    incremental.numDeleted = 0;
+                    incremental.phase = MARK;
+                    ++work;
+                    break;
+                }
+                {
+                    uint32_t status = hp->status.load();
+                    if (status == USED || status == OWNED)
+                    {
+                        usedPointers.push_back(hp->ptr.load());
+                    }
+                }
+                hp = hp->next;
+                ++work;
+                break;
+
+            case MARK:
+                if (incremental.index == candidates.size())
+                {
+                    LOCKFREE_PROBE(SCAN_END, candidates.size(), incremental.numDeleted);
+                    incremental.index = 0;
+                    incremental.phase = DELETE;
+                    break;
+                }
+                mark(candidates[incremental.index++], incremental.deleted, incremental.numDeleted);
+                ++work;
+                break;
+
+            case DELETE:
+                if (incremental.index == candidates.size())
+                {
+                    incremental.phase = IDLE;
+                    compactIfThreadsExited();
+                    work = maxWork; //the next scan starts with the next retire
+                    break;
+                }
+                //a nested complete scan (of an object deleted here) aborts this one
+                deleteIfReady(candidates[incremental.index++].hp);
+                ++work;
+                break;
+            }
+        }
+
+        incremental.running = false;
+        if (observer)
+        {
+            observer(std::chrono::steady_clock::now() - start);
+        }
+    }
+
+    void compactIfThreadsExited()
+    {
+        if (threadStates->numExited.load(std::memory_order_relaxed) > 0)
+        {
+            threadStates->numExited.store(0, std::memory_order_relaxed);
+            compact();
+        }
+    }
+
+    //unlink the free hazard pointers which are no hint of a thread (i.e. mostly those of exited threads),
+    //such that scans only walk the hazard pointers of running threads (called under deleteMutex)
+    //owned hazard pointers of exited threads are freed first (unless a reader still holds one)
+    void compact()
+    {
+        HazardPointer *hints[MAX_THREAD_STATES];
+        for (uint32_t i = 0; i < MAX_THREAD_STATES; ++i)
+        {
+            hints[i] = threadStates->states[i].hint.load(std::memory_order_relaxed);
+        }
+
+        std::lock_guard<std::mutex> g(removedMutex);
+        HazardPointer *prev = nullptr;
+        auto hp = hazardPointers.load();
+        while (hp)
+        {
+            auto next = hp->next.load();
+            if (hp->status.load() == OWNED && !hp->taken.load() && !isOwned(hp))
+            {
+                uint32_t expectedOwned = OWNED;
+                hp->status.compare_exchange_strong(expectedOwned, FREE);
+            }
+            uint32_t expectedStatus = FREE;
+            if (std::find(hints, hints + MAX_THREAD_STATES, hp) == hints + MAX_THREAD_STATES &&
+                hp->status.load() == FREE && hp->status.compare_exchange_strong(expectedStatus, REMOVED))
+            {
+                //new hazard pointers are only inserted in front, which we cannot change if it is no longer hp
+                //(hp keeps its next, a thread in acquire may still be at hp and continues with the rest of the list)
+                auto head = hp;
+                if (prev ? (prev->next.store(next), true) : hazardPointers.compare_exchange_strong(head, next))
+                {
+                    removed.push_back(hp);
+                    numListed.fetch_sub(1);
+                    hp = next;
+                    continue;
+                }
+                hp->status.store(FREE);
+            }
+            prev = hp;
+            hp = next;
+        }
+        LOCKFREE_PROBE(COMPACT, this, removed.size());
+    }
+
+    //a thread stores its owned hazard pointer before it marks it owned and removes it only when it exits
+    bool isOwned(HazardPointer *hp) const
+    {
+        for (auto &state : threadStates->states)
+        {
+            if (state.owned.load() == hp)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void tryDelete()
+    {
+        auto hp = hazardPointers.load();
+        while (hp)
+        {
+            deleteIfReady(hp);
+            hp = hp->next;
+        }
+    }
+
+    //hazard pointers are freed before their object is deleted, thus deleting cannot observe them in a scan it causes
+    void deleteIfReady(HazardPointer *hp)
+    {
+        if (hp->status.load() != READY_TO_DELETE)
+        {
+            return;
+        }
+        auto ptr = hp->ptr.load();
+        auto owner = hp->owner;
+        auto reclaim = hp->reclaim;
+        hp->status.store(FREE);
+        reclaim(owner, ptr);
+    }
+
+    //nullptr if no more hazard pointers can be created
+    HazardPointer *createHazardPointer()
+    {
+        {
+            //an unlinked one is not walked by any scan (and acquire only takes FREE ones), it can be inserted again
+            std::lock_guard<std::mutex> g(removedMutex);
+            if (!removed.empty())
+            {
+                auto hp = removed.back();
+                removed.pop_back();
+                return hp;
+            }
+        }
+
+        auto id = numHazardPointersCreated.load();
+        do
+        {
+            if (id >= maxHazardPointers.load())
+            {
+                return nullptr;
+            }
+        } while (!numHazardPointersCreated.compare_exchange_weak(id, id + 1));
+        return new (resource->allocate(sizeof(HazardPointer), alignof(HazardPointer))) HazardPointer(id);
+    }
+
+    void destroyHazardPointer(HazardPointer *hp)
+    {
+        hp->~HazardPointer();
+        resource->deallocate(hp, sizeof(HazardPointer), alignof(HazardPointer));
+    }
+};
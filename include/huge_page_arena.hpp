@@ -0,0 +1,172 @@
+#pragma once
+#include "allocator.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+
+#include <sys/mman.h>
+
+//memory for versions (or hazard pointers) from a large region backed by huge pages, which reduces TLB misses
+//when objects with many (large) versions are updated often
+//
+//explicit huge pages (MAP_HUGETLB) need pages reserved by the system (vm.nr_hugepages), otherwise regular pages
+//with the advice to use transparent huge pages are mapped, if this fails as well everything comes from upstream
+
+class HugePageResource : public std::pmr::memory_resource
+{
+public:
+    static constexpr size_t HUGE_PAGE_SIZE{2 * 1024 * 1024};
+
+    enum Backing
+    {
+        HUGE_PAGES,             //explicit huge pages
+        TRANSPARENT_HUGE_PAGES, //regular pages, the kernel was advised to use huge pages
+        REGULAR_PAGES,          //regular pages (advice not supported)
+        UPSTREAM                //no region could be mapped
+    };
+
+    //size is rounded up to huge pages, memory beyond the region is allocated from upstream
+    explicit HugePageResource(size_t size = 32 * HUGE_PAGE_SIZE,
+                              std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+        : size((size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE), upstream(upstream)
+    {
+        void *region = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        region = mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        backing = HUGE_PAGES;
+#endif
+        if (region == MAP_FAILED)
+        {
+            region = mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            backing = REGULAR_PAGES;
+#ifdef MADV_HUGEPAGE
+            if (region != MAP_FAILED && madvise(region, this->size, MADV_HUGEPAGE) == 0)
+            {
+                backing = TRANSPARENT_HUGE_PAGES;
+            }
+#endif
+        }
+
+        if (region == MAP_FAILED)
+        {
+            backing = UPSTREAM;
+            this->size = 0;
+            return;
+        }
+        base = static_cast<char *>(region);
+    }
+
+    ~HugePageResource()
+    {
+        if (base)
+        {
+            munmap(base, size);
+        }
+    }
+
+    HugePageResource(const HugePageResource &) = delete;
+    HugePageResource(HugePageResource &&) = delete;
+
+    Backing getBacking() const
+    {
+        return backing;
+    }
+
+    //bytes of the region in use
+    size_t used() const
+    {
+        return std::min(offset.load(std::memory_order_relaxed), size);
+    }
+
+    void print()
+    {
+        static const char *names[] = {"huge pages", "transparent huge pages", "regular pages", "upstream"};
+        std::cout << "HugePageResource " << names[backing] << " used " << used() << " of " << size << " bytes" << std::endl;
+    }
+
+private:
+    size_t size;
+    std::pmr::memory_resource *upstream;
+    Backing backing{UPSTREAM};
+    char *base{nullptr};
+    std::atomic<size_t> offset{0};
+
+    //memory of the region is never reused (monotonic), a pool on top of the resource recycles it
+    void *do_allocate(size_t bytes, size_t alignment) override
+    {
+        auto current = offset.load(std::memory_order_relaxed);
+        size_t aligned;
+        do
+        {
+            aligned = (current + alignment - 1) & ~(alignment - 1);
+            if (aligned + bytes > size)
+            {
+                return upstream->allocate(bytes, alignment);
+            }
+        } while (!offset.compare_exchange_weak(current, aligned + bytes, std::memory_order_relaxed));
+        return base + aligned;
+    }
+
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override
+    {
+        auto address = static_cast<char *>(p);
+        if (address >= base && address < base + size)
+        {
+            return; //released with the region
+        }
+        upstream->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+//like ArenaAllocator, but the pool gets its memory from a huge page region
+//default constructed instances share one region, an object gets its own region with HugePageAllocator(size)
+class HugePageAllocator : public PmrAllocator
+{
+public:
+    static constexpr size_t DEFAULT_SIZE{32 * HugePageResource::HUGE_PAGE_SIZE};
+
+    HugePageAllocator() : arena(shared())
+    {
+        resource = &arena->pool;
+    }
+
+    //a private region
+    explicit HugePageAllocator(size_t size) : arena(std::make_shared<Arena>(size))
+    {
+        resource = &arena->pool;
+    }
+
+    void print()
+    {
+        arena->pages.print();
+    }
+
+private:
+    struct Arena
+    {
+        Arena(size_t size) : pages(size), pool(&pages)
+        {
+        }
+
+        HugePageResource pages;
+        std::pmr::synchronized_pool_resource pool;
+    };
+
+    std::shared_ptr<Arena> arena;
+
+    //mapped on first use, kept alive by the allocators using it
+    static std::shared_ptr<Arena> shared()
+    {
+        static std::shared_ptr<Arena> s_arena(std::make_shared<Arena>(DEFAULT_SIZE));
+        return s_arena;
+    }
+};
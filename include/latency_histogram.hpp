@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+//histogram of latencies in nanoseconds with bounded relative error (in the style of HdrHistogram):
+//values below 2^SUB_BITS are counted exactly, above every power of two is divided into 2^(SUB_BITS - 1) linear buckets
+//
+//recording is a few instructions without synchronization, hence every thread records into its own histogram
+//and they are merged afterwards
+
+class LatencyHistogram
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void record(uint64_t nanoseconds)
+    {
+        counts[index(nanoseconds)]++;
+        numValues++;
+        sum += nanoseconds;
+        maxValue = std::max(maxValue, nanoseconds);
+    }
+
+    void record(Clock::duration duration)
+    {
+        record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        for (size_t i = 0; i < NUM_BUCKETS; ++i)
+        {
+            counts[i] += other.counts[i];
+        }
+        numValues += other.numValues;
+        sum += other.sum;
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+
+    //upper bound of the bucket containing the value at percentile p (0 - 100), i.e. at most the relative error too high
+    uint64_t percentile(double p) const
+    {
+        if (numValues == 0)
+        {
+            return 0;
+        }
+
+        auto rank = static_cast<uint64_t>(p / 100 * numValues + 0.5);
+        rank = std::min(std::max<uint64_t>(rank, 1), numValues);
+        uint64_t count = 0;
+        for (size_t i = 0; i < NUM_BUCKETS; ++i)
+        {
+            count += counts[i];
+            if (count >= rank)
+            {
+                return std::min(upperBound(i), maxValue);
+            }
+        }
+        return maxValue;
+    }
+
+    uint64_t max() const
+    {
+        return maxValue;
+    }
+
+    uint64_t count() const
+    {
+        return numValues;
+    }
+
+    double mean() const
+    {
+        return numValues ? static_cast<double>(sum) / numValues : 0.;
+    }
+
+    //one line, all values in ns
+    void print(const std::string &name) const
+    {
+        std::cout << std::left << std::setw(16) << name << std::right
+                  << " count " << std::setw(9) << count()
+                  << " p50 " << std::setw(7) << percentile(50)
+                  << " p99 " << std::setw(7) << percentile(99)
+                  << " p99.9 " << std::setw(8) << percentile(99.9)
+                  << " max " << std::setw(9) << max() << std::endl;
+    }
+
+private:
+    static constexpr uint32_t SUB_BITS{5}; //relative error at most 2^-(SUB_BITS - 1), i.e. about 6%
+    static constexpr uint64_t SUB_COUNT{1u << SUB_BITS};
+    static constexpr uint64_t HALF_COUNT{SUB_COUNT / 2};
+    static constexpr size_t NUM_BUCKETS{SUB_COUNT + (64 - SUB_BITS) * HALF_COUNT};
+
+    std::array<uint64_t, NUM_BUCKETS> counts{};
+    uint64_t numValues{0};
+    uint64_t sum{0};
+    uint64_t maxValue{0};
+
+    static size_t index(uint64_t value)
+    {
+        if (value < SUB_COUNT)
+        {
+            return value;
+        }
+        uint32_t magnitude = 63 - __builtin_clzll(value);
+        uint32_t shift = magnitude - SUB_BITS + 1;
+        return SUB_COUNT + (shift - 1) * HALF_COUNT + ((value >> shift) - HALF_COUNT);
+    }
+
+    static uint64_t upperBound(size_t index)
+    {
+        if (index < SUB_COUNT)
+        {
+            return index;
+        }
+        uint32_t shift = (index - SUB_COUNT) / HALF_COUNT + 1;
+        uint64_t top = (index - SUB_COUNT) % HALF_COUNT + HALF_COUNT;
+        return ((top + 1) << shift) - 1;
+    }
+};
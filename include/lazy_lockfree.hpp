@@ -0,0 +1,214 @@
+#pragma once
+#include "lockfree_wrapper.hpp"
+
+#include <atomic>
+#include <functional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+//for write mostly objects: updates are not applied to a copy immediately but appended to a log
+//of the current version, only the next reader (or a writer if the log becomes too long) copies the object once
+//and applies all pending updates (materializes a new version)
+//
+//writers pay for a log record instead of a copy, but do not get the result of their update
+//versions and log records are allocated with Alloc
+
+template <typename T, typename Alloc = Allocator>
+class LazyLockFree
+{
+private:
+    struct Record
+    {
+        Record(std::function<void(T *)> &&apply) : apply(std::move(apply))
+        {
+        }
+
+        std::function<void(T *)> apply;
+        Record *next{nullptr};
+        size_t size{1}; //number of records in the log up to this one
+    };
+
+    struct Version
+    {
+        template <typename... Args>
+        Version(std::in_place_t, Alloc *allocator, Args &&... args) : object(std::forward<Args>(args)...), allocator(allocator)
+        {
+        }
+
+        //copy to materialize the next version, the log of other still has to be applied (fold)
+        Version(const Version &other) : object(other.object), allocator(other.allocator), predecessor(&other)
+        {
+        }
+
+        ~Version()
+        {
+            auto record = reinterpret_cast<Record *>(log.load() & ~CLOSED);
+            while (record)
+            {
+                auto next = record->next;
+                allocator->free(record);
+                record = next;
+            }
+        }
+
+        //fails if the log was closed, i.e. the version is about to be replaced by a materialized one
+        bool append(Record *record) const
+        {
+            auto head = log.load();
+            do
+            {
+                if (head & CLOSED)
+                {
+                    return false;
+                }
+                record->next = reinterpret_cast<Record *>(head);
+                record->size = record->next ? record->next->size + 1 : 1;
+            } while (!log.compare_exchange_weak(head, reinterpret_cast<uintptr_t>(record)));
+            return true;
+        }
+
+        bool pending() const
+        {
+            return log.load() != 0;
+        }
+
+        //apply the (closed) log of the predecessor, everyone folding the same predecessor applies the same records
+        void fold()
+        {
+            auto head = predecessor->log.load();
+            while (!(head & CLOSED) && !predecessor->log.compare_exchange_weak(head, head | CLOSED))
+            {
+            }
+            predecessor = nullptr;
+
+            //the log is a stack, apply the oldest record first
+            std::vector<Record *> records;
+            for (auto record = reinterpret_cast<Record *>(head & ~CLOSED); record; record = record->next)
+            {
+                records.push_back(record);
+            }
+            for (auto iter = records.rbegin(); iter != records.rend(); ++iter)
+            {
+                (*iter)->apply(&object);
+            }
+        }
+
+        T object;
+        Alloc *allocator; //of the records
+        mutable std::atomic<uintptr_t> log{0}; //Record *, lowest bit is set once the log is closed
+        const Version *predecessor{nullptr};   //only set for a version not yet published
+    };
+
+public:
+    template <typename S>
+    class ReadOnlyProxy
+    {
+    public:
+        friend class LazyLockFree<T, Alloc>;
+
+        const S *operator->()
+        {
+            return &proxy->object;
+        }
+
+        const S &operator*()
+        {
+            return proxy->object;
+        }
+
+    private:
+        typename LockFree<Version, Alloc>::template ReadOnlyProxy<Version> proxy;
+
+        ReadOnlyProxy(LockFree<Version, Alloc> &versions) : proxy(versions.readOnly())
+        {
+        }
+    };
+
+    //the log is materialized by a writer when it contains threshold records
+    template <typename... Args>
+    LazyLockFree(size_t threshold, Args &&... args) : LazyLockFree(std::allocator_arg, Alloc(), threshold, std::forward<Args>(args)...)
+    {
+    }
+
+    template <typename... Args>
+    LazyLockFree(std::allocator_arg_t, Alloc allocator, size_t threshold, Args &&... args)
+        : threshold(threshold), allocator(allocator),
+          versions(std::allocator_arg, allocator, std::in_place, &this->allocator, std::forward<Args>(args)...)
+    {
+    }
+
+    LazyLockFree(const LazyLockFree &) = delete;
+    LazyLockFree(LazyLockFree &&) = delete;
+
+    //appends the update, it is applied to a copy when the object is read or the log is long enough
+    template <typename Function, typename... Params>
+    void invoke(Function &&f, Params &&... params)
+    {
+        auto record = allocator.template allocate<Record>(
+            [f = std::forward<Function>(f), params = std::make_tuple(std::forward<Params>(params)...)](T *object) {
+                //may be applied to several copies concurrently (only one of them is published)
+                std::apply([&](const auto &... p) { std::invoke(f, object, p...); }, params);
+            });
+
+        do
+        {
+            bool appended;
+            size_t size;
+            {
+                auto version = versions.readOnly();
+                appended = version->append(record);
+                size = record->size; //afterwards the record may be folded and deleted concurrently
+            }
+
+            if (appended)
+            {
+                if (size >= threshold)
+                {
+                    materialize();
+                }
+                return;
+            }
+
+            //the log was closed by a concurrent materialization, help to finish it and retry on the new version
+            materialize();
+        } while (true);
+    }
+
+    //contains all updates completed before
+    ReadOnlyProxy<T> readOnly()
+    {
+        materialize();
+        return ReadOnlyProxy<T>(versions);
+    }
+
+    //apply all pending updates to a copy and publish it
+    void materialize()
+    {
+        {
+            auto version = versions.readOnly();
+            if (!version->pending())
+            {
+                return;
+            }
+        }
+
+        versions.invoke([](Version *copy) {
+            copy->fold();
+            return true;
+        });
+    }
+
+    //number of materialized versions, i.e. of copies made so far
+    uint64_t version() const
+    {
+        return versions.version();
+    }
+
+private:
+    static constexpr uintptr_t CLOSED{1};
+
+    const size_t threshold;
+    Alloc allocator; //must outlive the versions
+    LockFree<Version, Alloc> versions;
+};
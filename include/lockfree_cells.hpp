@@ -0,0 +1,154 @@
+#pragma once
+#include "lockfree_wrapper.hpp"
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <utility>
+
+//containers of cells which are updated independently like LockFree objects (copy on write), but
+//share the hazard domain and allocator of the container, hence a cell is only a pointer to its current version
+//(updates of different cells never fail because of each other, only cells in the same cache line share it)
+//
+//per cell this is one pointer plus the allocation of the current version (T and what Alloc adds to each allocation)
+//
+//cells cannot take part in multi updates, their pointers never hold a descriptor
+//
+//updates follow the protocol of LockFree (CopyOnWrite), hence commit hooks, waiters, backpressure and the reclamation
+//and recycling policies apply to all cells of a container (readOnly is offered regardless of the proxy policy)
+
+template <typename T, typename Alloc = Allocator, typename Policy = DefaultPolicy>
+class LockFreeCells : public CopyOnWrite<T, Alloc, Policy>
+{
+protected:
+    using Base = CopyOnWrite<T, Alloc, Policy>;
+    using HazardPointer = HazardDomain::HazardPointer;
+
+public:
+    //read access to (part of) the version of a cell as long as the proxy lives
+    template <typename S>
+    class ReadOnlyProxy
+    {
+    public:
+        friend class LockFreeCells<T, Alloc, Policy>;
+        ~ReadOnlyProxy()
+        {
+            domain->release(*hp);
+        }
+
+        const S *operator->()
+        {
+            return object;
+        }
+
+        const S &operator*()
+        {
+            return *object;
+        }
+
+        //false if there is nothing to read (e.g. a key which is not in a map)
+        explicit operator bool() const
+        {
+            return object != nullptr;
+        }
+
+    private:
+        HazardDomain *domain;
+        HazardPointer *hp;
+        const S *object;
+
+        ReadOnlyProxy(HazardDomain *domain, HazardPointer *hp, const S *object) : domain(domain), hp(hp), object(object)
+        {
+        }
+    };
+
+protected:
+    //the derived container deletes the current versions of its cells
+    LockFreeCells(HazardDomain &domain, Alloc allocator) : Base(std::move(allocator), domain)
+    {
+    }
+
+    template <typename... Args>
+    void initialize(std::atomic<T *> &cell, Args &&... args)
+    {
+        cell.store(this->allocate(std::forward<Args>(args)...));
+    }
+
+    void destroy(std::atomic<T *> &cell)
+    {
+        this->deallocate(cell.load());
+    }
+
+    //the returned hazard pointer protects the current version of cell (only to read it)
+    HazardPointer *protect(std::atomic<T *> &cell)
+    {
+        return this->acquireForRead(cell);
+    }
+
+    template <typename S>
+    ReadOnlyProxy<S> proxy(HazardPointer *hp, const S *object)
+    {
+        return ReadOnlyProxy<S>(this->domain, hp, object);
+    }
+
+    ReadOnlyProxy<T> readOnly(std::atomic<T *> &cell)
+    {
+        auto hp = protect(cell);
+        return proxy(hp, hp->template get<T>());
+    }
+};
+
+//fixed number of cells stored contiguously in the array object
+template <typename T, size_t N, typename Alloc = Allocator, typename Policy = DefaultPolicy>
+class LockFreeArray : public LockFreeCells<T, Alloc, Policy>
+{
+    using Base = LockFreeCells<T, Alloc, Policy>;
+
+public:
+    template <typename S>
+    using ReadOnlyProxy = typename Base::template ReadOnlyProxy<S>;
+
+    LockFreeArray(const T &initial = T(), HazardDomain &domain = HazardDomain::global(), Alloc allocator = Alloc())
+        : Base(domain, std::move(allocator))
+    {
+        for (auto &cell : cells)
+        {
+            this->initialize(cell, initial);
+        }
+    }
+
+    ~LockFreeArray()
+    {
+        for (auto &cell : cells)
+        {
+            this->destroy(cell);
+        }
+    }
+
+    constexpr size_t size() const
+    {
+        return N;
+    }
+
+    ReadOnlyProxy<T> readOnly(size_t index)
+    {
+        return Base::readOnly(cells[index]);
+    }
+
+    //like LockFree::invoke for the object at index
+    template <typename Function, typename... Params>
+    decltype(auto) invoke(size_t index, Function &&f, Params &&... params)
+    {
+        return Base::invoke(cells[index], std::forward<Function>(f), std::forward<Params>(params)...);
+    }
+
+    //like LockFree::tryInvoke for the object at index
+    template <typename Function, typename... Params>
+    auto tryInvoke(size_t index, Function &&f, Params &&... params)
+    {
+        return Base::tryInvoke(cells[index], std::forward<Function>(f), std::forward<Params>(params)...);
+    }
+
+private:
+    std::array<std::atomic<T *>, N> cells;
+};
@@ -0,0 +1,122 @@
+#pragma once
+#include "lockfree_cells.hpp"
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+//concurrent hash map with a fixed number of buckets, every bucket is a copy on write cell
+//updates copy the (small) bucket of the key, hence updates of keys in different buckets never fail because of each other
+//and readers are never blocked
+//
+//the number of buckets is not changed, it should be chosen such that buckets contain few keys
+//
+//memory: every bucket is a cell (one pointer) with a version, i.e. a std::vector allocated by Alloc (one allocation
+//with the vector itself, plus what Alloc adds) whose entries are in a second allocation (std::allocator), an entry
+//takes sizeof(std::pair<K, V>) in it (published versions have no spare capacity), hence a key costs that plus its share
+//of the bucket: (pointer + sizeof(std::vector) + 2 allocations) / keys per bucket, not only one pointer
+//(MonitoredAllocator, the default Allocator, also tracks every version in a std::map, use e.g. DefaultAllocator)
+
+template <typename K, typename V, typename Hash = std::hash<K>, typename Alloc = Allocator, typename Policy = DefaultPolicy>
+class LockFreeMap : public LockFreeCells<std::vector<std::pair<K, V>>, Alloc, Policy>
+{
+    using Bucket = std::vector<std::pair<K, V>>;
+    using Base = LockFreeCells<Bucket, Alloc, Policy>;
+
+public:
+    template <typename S>
+    using ReadOnlyProxy = typename Base::template ReadOnlyProxy<S>;
+
+    LockFreeMap(size_t numBuckets = 1024, HazardDomain &domain = HazardDomain::global(), Alloc allocator = Alloc())
+        : Base(domain, std::move(allocator)), buckets(std::max<size_t>(numBuckets, 1))
+    {
+        for (auto &bucket : buckets)
+        {
+            this->initialize(bucket);
+        }
+    }
+
+    ~LockFreeMap()
+    {
+        for (auto &bucket : buckets)
+        {
+            this->destroy(bucket);
+        }
+    }
+
+    size_t numBuckets() const
+    {
+        return buckets.size();
+    }
+
+    //the value of key (if the proxy converts to true), it does not change during the lifetime of the proxy
+    ReadOnlyProxy<V> find(const K &key)
+    {
+        auto hp = this->protect(bucket(key));
+        auto entry = find(*hp->template get<Bucket>(), key);
+        return this->proxy(hp, entry ? &entry->second : static_cast<const V *>(nullptr));
+    }
+
+    //apply f to the value of key, which is default constructed if the key is not in the map (like operator[])
+    template <typename Function, typename... Params>
+    decltype(auto) invoke(const K &key, Function &&f, Params &&... params)
+    {
+        return Base::invoke(bucket(key), [&](Bucket *copy) {
+            auto entry = find(*copy, key);
+            if (!entry)
+            {
+                copy->reserve(copy->size() + 1);
+                copy->emplace_back(key, V());
+                entry = &copy->back();
+            }
+            return std::invoke(f, &entry->second, params...);
+        });
+    }
+
+    //returns false if the key was already in the map (its value is not changed and nothing is published then)
+    bool insert(const K &key, const V &value)
+    {
+        return Base::invokeIf(
+            bucket(key), [&](const Bucket &current) { return !find(current, key); },
+            [&](Bucket *copy) {
+                copy->reserve(copy->size() + 1); //exactly, copies have no spare capacity
+                copy->emplace_back(key, value);
+            });
+    }
+
+    //returns false if the key was not in the map (nothing is published then)
+    bool erase(const K &key)
+    {
+        return Base::invokeIf(
+            bucket(key), [&](const Bucket &current) { return find(current, key) != nullptr; },
+            [&](Bucket *copy) {
+                auto entry = find(*copy, key);
+                if (entry != &copy->back())
+                {
+                    *entry = std::move(copy->back());
+                }
+                copy->pop_back();
+            });
+    }
+
+private:
+    std::vector<std::atomic<Bucket *>> buckets;
+
+    std::atomic<Bucket *> &bucket(const K &key)
+    {
+        return buckets[Hash()(key) % buckets.size()];
+    }
+
+    template <typename B>
+    static auto find(B &bucket, const K &key) -> decltype(&bucket[0])
+    {
+        for (auto &entry : bucket)
+        {
+            if (entry.first == key)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include "hazard_domain.hpp"
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+//policies of LockFree, each combination is a different strategy with the same invoke interface
+//  Reclamation: where the hazard pointers of an object live
+//  Recycling:   what invoke does with its hazard pointer if the CAS failed
+//  Proxies:     which access besides invoke an object offers
+
+//hazard pointers of a domain shared with other objects (the global one unless the object is constructed with one)
+struct SharedReclamation
+{
+    static HazardDomain *domain(HazardDomain &shared, std::unique_ptr<HazardDomain> &)
+    {
+        return &shared;
+    }
+};
+
+//hazard pointers only used by the object (it scans only its own list, but does not share unused hazard pointers)
+struct PrivateReclamation
+{
+    static HazardDomain *domain(HazardDomain &, std::unique_ptr<HazardDomain> &own)
+    {
+        own = std::make_unique<HazardDomain>();
+        return own.get();
+    }
+};
+
+//release the hazard pointer and acquire one again for the next attempt
+struct ReleaseOnConflict
+{
+    static constexpr bool recycle{false};
+};
+
+//keep the hazard pointer and only protect the new current object with it
+struct RecycleOnConflict
+{
+    static constexpr bool recycle{true};
+};
+
+//only invoke (and tryInvoke)
+struct NoProxies
+{
+    static constexpr bool readOnly{false};
+    static constexpr bool tryWrite{false};
+};
+
+//readOnly
+struct ReadProxies
+{
+    static constexpr bool readOnly{true};
+    static constexpr bool tryWrite{false};
+};
+
+//readOnly, tryWrite and operator->
+struct AllProxies
+{
+    static constexpr bool readOnly{true};
+    static constexpr bool tryWrite{true};
+};
+
+template <typename ReclamationPolicy = SharedReclamation, typename RecyclingPolicy = ReleaseOnConflict,
+          typename ProxyPolicy = AllProxies>
+struct Policy
+{
+    using Reclamation = ReclamationPolicy;
+    using Recycling = RecyclingPolicy;
+    using Proxies = ProxyPolicy;
+};
+
+using DefaultPolicy = Policy<>;
+
+//every combination, e.g. to compare their throughput
+using AllPolicies = std::tuple<Policy<SharedReclamation, ReleaseOnConflict, NoProxies>,
+                               Policy<SharedReclamation, ReleaseOnConflict, ReadProxies>,
+                               Policy<SharedReclamation, ReleaseOnConflict, AllProxies>,
+                               Policy<SharedReclamation, RecycleOnConflict, NoProxies>,
+                               Policy<SharedReclamation, RecycleOnConflict, ReadProxies>,
+                               Policy<SharedReclamation, RecycleOnConflict, AllProxies>,
+                               Policy<PrivateReclamation, ReleaseOnConflict, NoProxies>,
+                               Policy<PrivateReclamation, ReleaseOnConflict, ReadProxies>,
+                               Policy<PrivateReclamation, ReleaseOnConflict, AllProxies>,
+                               Policy<PrivateReclamation, RecycleOnConflict, NoProxies>,
+                               Policy<PrivateReclamation, RecycleOnConflict, ReadProxies>,
+                               Policy<PrivateReclamation, RecycleOnConflict, AllProxies>>;
+
+//e.g. "shared/release/all"
+template <typename P>
+std::string policyName()
+{
+    std::string name = std::is_same<typename P::Reclamation, SharedReclamation>::value ? "shared" : "private";
+    name += P::Recycling::recycle ? "/recycle" : "/release";
+    name += P::Proxies::tryWrite ? "/all" : P::Proxies::readOnly ? "/read" : "/none";
+    return name;
+}
@@ -1,14 +1,21 @@
 #pragma once
 #include "allocator.hpp"
+#include "copy_on_write.hpp"
+#include "multi_update.hpp"
+#include "hazard_domain.hpp"
+#include "lockfree_policies.hpp"
 
 #include <atomic>
 #include <functional>
-#include <set>
 #include <vector>
 #include <algorithm>
-#include <list>
+#include <array>
+#include <chrono>
 #include <string>
 #include <thread>
+#include <tuple>
+#include <memory>
+#include <optional>
 
 #include <mutex>
 
@@ -17,78 +24,25 @@
 //potentially useful for read often, write seldom lockfree structures
 //or prototyping where performance is not the primary issue (the internal copies are quite inefficient)
 
-//todo: generalize allocation, deal with failures/bounded resources
+//todo: deal with allocation failures/bounded resources
 //todo: memory order
 //todo: interface, proxy design, copy/move
 //todo: optimization
 //todo: transaction proxy (similar to writer, but with explicit writeback)
 
+//default allocator of all LockFree objects, can be chosen per object with the Alloc parameter
+//(e.g. PmrAllocator or ArenaAllocator(reservedSize) to give hot objects their own memory)
 //using Allocator = DefaultAllocator;
 using Allocator = MonitoredAllocator;
 
-template <typename T>
-class LockFree
+//the strategy (reclamation, hazard pointer recycling, proxies) is selected with Policy, see lockfree_policies.hpp
+//the update protocol and what is offered around it (commit hooks, waiters, backpressure) is in CopyOnWrite
+template <typename T, typename Alloc = Allocator, typename Policy = DefaultPolicy>
+class LockFree : public CopyOnWrite<T, Alloc, Policy>
 {
 private:
-    enum Status
-    {
-        FREE,             //the hazard pointer can be acquired and its pointer set
-        USED,             //the hazard pointer is in use and protecting what ptr points to
-        RELEASED,         //the hazard pointer was released but its protected ptr not cleaned up (which might not be possible if there are other users)
-        DELETE_CANDIDATE, //the hazard pointer was released and one instance of its protected ptr can be deleted
-        READY_TO_DELETE   //the hazard pointer was released and this specific ptr instance can be deleted
-    };
-
-    struct HazardPointer
-    {
-        HazardPointer(uint64_t id = 0) : id(id)
-        {
-        }
-
-        void print()
-        {
-            std::cout << "HP " << id << " " << this << " ptr " << ptr.load() << " " << statusStr() << std::endl;
-        }
-
-        std::string statusStr()
-        {
-            switch (status)
-            {
-            case FREE:
-                return "FREE";
-            case USED:
-                return "USED";
-            case RELEASED:
-                return "RELEASED";
-            case DELETE_CANDIDATE:
-                return "DELETE_CANDIDATE";
-            case READY_TO_DELETE:
-                return "READY_TO_DELETE";
-            }
-            return "";
-        }
-
-        bool updateStatus(uint32_t expected, uint32_t desired)
-        {
-            uint32_t oldStatus = expected;
-            do
-            {
-                if (status.compare_exchange_weak(oldStatus, desired))
-                {
-                    return true;
-                }
-            } while (oldStatus == expected);
-            return false;
-        }
-
-        std::atomic<T *> ptr{nullptr}; //the payload we want to protect todo: can be mase nonatomic in conjunctio with atomic status?
-        HazardPointer *next{nullptr};
-        std::atomic<uint32_t> status{FREE};
-        std::atomic_flag deletionInProgress{false};
-        const uint64_t id; //unique and does not change (todo: not needed, can use the this pointer instead later)
-
-        std::mutex mutex;
-    };
+    using Base = CopyOnWrite<T, Alloc, Policy>;
+    using HazardPointer = HazardDomain::HazardPointer;
 
 public:
     //as long as this object lives, we have read access to the object state (which may be outdated, however)
@@ -97,7 +51,7 @@ public:
     class ReadOnlyProxy
     {
     public:
-        friend class LockFree<T>;
+        friend class LockFree<T, Alloc, Policy>;
         ~ReadOnlyProxy()
         {
             wrapper->releaseHazardPointer(*hp);
@@ -108,15 +62,20 @@ public:
             return object;
         }
 
+        const S &operator*()
+        {
+            return *object;
+        }
+
     private:
         HazardPointer *hp;
         S *object;
-        LockFree<S> *wrapper;
+        LockFree<S, Alloc, Policy> *wrapper;
 
-        ReadOnlyProxy(LockFree<S> &wrapper) : wrapper(&wrapper)
+        ReadOnlyProxy(LockFree<S, Alloc, Policy> &wrapper) : wrapper(&wrapper)
         {
-            hp = this->wrapper->acquireHazardPointer(); //todo: deal with failure (hard to do, we need the raw pointer in operator->)
-            object = hp->ptr.load();
+            hp = this->wrapper->acquireForRead(this->wrapper->currentObjectPtr); //todo: deal with failure (hard to do, we need the raw pointer in operator->)
+            object = hp->template get<S>();
         }
 
         //ReadOnlyProxy(const ReadOnlyProxy &) = default;
@@ -127,15 +86,13 @@ public:
     class TryWriteProxy
     {
     public:
-        friend class LockFree<T>;
+        friend class LockFree<T, Alloc, Policy>;
         ~TryWriteProxy()
         {
-            if (!wrapper->updateObject(object, copy))
+            if (!wrapper->publish(wrapper->currentObjectPtr, hp, object, copy, 1))
             {
-                wrapper->deallocate(copy);
+                wrapper->releaseHazardPointer(*hp);
             }
-
-            wrapper->releaseHazardPointer(*hp);
         }
 
         S *operator->()
@@ -147,12 +104,12 @@ public:
         HazardPointer *hp;
         S *object;
         S *copy;
-        LockFree<S> *wrapper;
+        LockFree<S, Alloc, Policy> *wrapper;
 
-        TryWriteProxy(LockFree<S> &wrapper) : wrapper(&wrapper)
+        TryWriteProxy(LockFree<S, Alloc, Policy> &wrapper) : wrapper(&wrapper)
         {
             hp = this->wrapper->acquireHazardPointer(); //todo: deal with failure
-            object = hp->ptr.load();
+            object = hp->template get<S>();
             copy = this->wrapper->allocate(*object);
         }
 
@@ -160,56 +117,92 @@ public:
         //TryWriteProxy(TryWriteProxy &&) = default;
     };
 
-public:
-    friend class ReadOnlyProxy<T>;
-    friend class TryWriteProxy<T>;
-
-    template <typename... Args>
-    LockFree(Args &&... args) : currentObjectHazardPointer(new HazardPointer(0))
-    {
-        auto initialObject = allocate(std::forward<Args>(args)...);
-        currentObjectHazardPointer->ptr.store(initialObject); //owned internally, only released in dtor, prevents deletion of current object
-        currentObjectHazardPointer->status.store(USED);
-        hazardPointers = new HazardPointer(0);
-    }
-
-    ~LockFree()
+    //long lived read access for one thread, which keeps its hazard pointer: get() only protects again
+    //if a new version was published, otherwise it is a single load
+    //the returned version is valid until the next get() (it keeps the version it read last alive until then)
+    class ReaderHandle
     {
-        std::cout << "Destructor #hazard pointers " << numHazardPointers.load() << std::endl;
-        //should maybe also block acquisition (recycling existing ones) but this is bad since we would need to check it always
-        // (acquisition will happen much more often compared to creation)
-        canCreateHazardPointer.store(false, std::memory_order_release);
-
-        auto hp = hazardPointers.load();
+    public:
+        ReaderHandle(LockFree<T, Alloc, Policy> &wrapper) : wrapper(&wrapper)
+        {
+            static_assert(Policy::Proxies::readOnly, "readOnly is not offered by the proxy policy");
+            hp = wrapper.domain->acquireForRead();
+            object = wrapper.protectCurrentObject(hp);
+        }
 
-        //std::this_thread::sleep_for(std::chrono::seconds(1));
+        ~ReaderHandle()
+        {
+            wrapper->releaseHazardPointer(*hp);
+        }
 
-        printHazards();
+        ReaderHandle(const ReaderHandle &) = delete;
+        ReaderHandle(ReaderHandle &&) = delete;
 
-        while (hp)
+        const T &get()
         {
-            if (hp->status.load() == USED)
+            //the object we protect is still current or we protect the current one
+            //(a descriptor of a multi update is never equal, protecting helps it)
+            if (wrapper->currentObjectPtr.load(std::memory_order_relaxed) != object)
             {
-                hp->status.store(RELEASED); //if there are active users this will cause problems (release their resource)
+                object = wrapper->protectCurrentObject(hp);
             }
-            hp = hp->next;
+            return *object;
+        }
+
+        const T *operator->()
+        {
+            return &get();
         }
 
-        printHazards();
+        const T &operator*()
+        {
+            return get();
+        }
 
-        deleteScan();
+    private:
+        LockFree<T, Alloc, Policy> *wrapper;
+        HazardPointer *hp;
+        const T *object;
+    };
 
-        printHazards();
+public:
+    friend class ReadOnlyProxy<T>;
+    friend class TryWriteProxy<T>;
+    friend class ReaderHandle;
+    friend class MultiUpdate;
+    template <typename... Wrappers>
+    friend class Snapshot;
 
-        deallocate(currentObjectHazardPointer->ptr.load());
+    using value_type = T;
 
-        hp = hazardPointers.load();
-        while (hp)
-        {
-            auto next = hp->next;
-            delete hp;
-            hp = next;
-        }
+    template <typename... Args>
+    LockFree(Args &&... args) : LockFree(std::allocator_arg, Alloc(), HazardDomain::global(), std::forward<Args>(args)...)
+    {
+    }
+
+    //all versions of the object are allocated with (a copy of) allocator
+    template <typename... Args>
+    LockFree(std::allocator_arg_t, Alloc allocator, Args &&... args)
+        : LockFree(std::allocator_arg, std::move(allocator), HazardDomain::global(), std::forward<Args>(args)...)
+    {
+    }
+
+    //the object uses the hazard pointers of domain, which must outlive it
+    template <typename... Args>
+    LockFree(HazardDomain &domain, Args &&... args) : LockFree(std::allocator_arg, Alloc(), domain, std::forward<Args>(args)...)
+    {
+    }
+
+    template <typename... Args>
+    LockFree(std::allocator_arg_t, Alloc allocator, HazardDomain &domain, Args &&... args) : Base(std::move(allocator), domain)
+    {
+        currentObjectPtr.store(this->allocate(std::forward<Args>(args)...)); //owned internally, never retired (only replaced versions are)
+    }
+
+    //no one may use the object anymore
+    ~LockFree()
+    {
+        this->deallocate(currentObjectPtr.load());
     }
 
     LockFree(const LockFree &) = delete;
@@ -219,21 +212,24 @@ public:
 
     T *currentObject()
     {
-        return currentObjectHazardPointer->ptr.load();
+        return loadCurrentObject();
     }
 
     bool updateObject(T *newObject)
     {
         auto hp = acquireHazardPointer(); //to protect the current object and be able to delete it later
-        T *expectedObject = hp->ptr.load();
+        T *expectedObject = hp->template get<T>();
+        auto newHp = this->protectForHook(newObject);
         //we cannot have an ABA problem here, ptr will be deleted and possibly recycled only after no one holds ptr anymore
         //in a hazardpointer (and therefore will not try to update with this old value)
-        if (currentObjectHazardPointer->ptr.compare_exchange_strong(expectedObject, newObject))
+        if (currentObjectPtr.compare_exchange_strong(expectedObject, newObject))
         {
-            releaseHazardPointer(*hp);
+            this->committed(expectedObject, newObject, newHp);
+            this->retireHazardPointer(*hp);
             return true;
         }
-        releaseHazardPointer(*hp);
+        this->releaseForHook(newHp);
+        this->releaseHazardPointer(*hp);
         return false;
     }
 
@@ -241,11 +237,18 @@ public:
 
     ReadOnlyProxy<T> readOnly()
     {
+        static_assert(Policy::Proxies::readOnly, "readOnly is not offered by the proxy policy");
         return ReadOnlyProxy<T>(*this);
     }
 
+    ReaderHandle reader()
+    {
+        return ReaderHandle(*this);
+    }
+
     TryWriteProxy<T> tryWrite()
     {
+        static_assert(Policy::Proxies::tryWrite, "tryWrite is not offered by the proxy policy");
         return TryWriteProxy<T>(*this);
     }
 
@@ -254,316 +257,215 @@ public:
         return tryWrite();
     }
 
-    //todo: implement, communicate success/failure
+    //like invoke, but only one attempt: the result is empty if the object was changed concurrently
+    //(or if there are too many unreclaimed versions, see setMaxUnreclaimed)
     template <typename Function, typename... Params>
-    decltype(auto) tryInvoke(Function &&f, Params &&... params)
+    auto tryInvoke(Function &&f, Params &&... params)
     {
+        return Base::tryInvoke(currentObjectPtr, std::forward<Function>(f), std::forward<Params>(params)...);
     }
 
-    //todo: variant without return value, does not need to compute result internally
+    //apply f to a copy of the current object and publish the copy, retried with a fresh copy if the object was changed concurrently
     template <typename Function, typename... Params>
     decltype(auto) invoke(Function &&f, Params &&... params)
     {
+        return Base::invoke(currentObjectPtr, std::forward<Function>(f), std::forward<Params>(params)...);
+    }
 
-        do
-        {
-            auto hp = acquireHazardPointer();
-            T *expected = hp->ptr.load();
-            T *copy = allocate(*expected); //local copy, protected against deletion by hp
-
-            auto result = std::invoke(f, copy, std::forward<Params>(params)...);
-
-            if (currentObjectHazardPointer->ptr.compare_exchange_strong(expected, copy))
-            {
-                releaseHazardPointer(*hp);
-                return result;
-            }
-
-            //our update failed, the copy is useless now
-            deallocate(copy); //could optimize and use in place construction in memory instead
-            releaseHazardPointer(*hp);
-
-            //we recycle the hazard pointer and load the new object state
-            // do
-            // {
-            //     hp->ptr.store(currentObject());
-            // } while (hp->ptr.load() != currentObject());
-
-        } while (true);
+    //like invoke, but only if condition(current object) holds, otherwise nothing is copied or published
+    //returns whether update(copy) was published
+    template <typename Condition, typename Update>
+    bool invokeIf(Condition &&condition, Update &&update)
+    {
+        return Base::invokeIf(currentObjectPtr, std::forward<Condition>(condition), std::forward<Update>(update));
     }
 
 private:
-    std::atomic_bool canCreateHazardPointer{true};
-    HazardPointer *currentObjectHazardPointer;
+    std::atomic<T *> currentObjectPtr{nullptr};
 
-    //hazardpointers are only created and not destroyed until the LockFree object goes out of scope
-    //(to make dealing with some ABA issues easier)
-    //the list only grows if new hazard pointers are needed, this avoids ABA problems but leads to inefficiencies
-    //this is also not the best structure to search in, there is potential for optimization
-    //but it shows the general idea
+    T *loadCurrentObject()
+    {
+        return Base::load(currentObjectPtr);
+    }
 
-    std::atomic<uint64_t> numHazardPointers{1}; //i.e. list size
-    std::atomic<uint64_t> numUsedHazardPointers{1};
-    std::atomic<uint64_t> numReleasedHazardPointers{0};
-    std::atomic<HazardPointer *> hazardPointers{nullptr}; //managed hazard pointers, can be used to protect objects
+    T *protectCurrentObject(HazardPointer *hp)
+    {
+        return Base::protect(currentObjectPtr, hp);
+    }
 
-    //get a free hazard pointer or create a new one
     HazardPointer *acquireHazardPointer()
     {
-        //we spin until a free one becomes available if creation is impossible
-        //later we could control the number available hazardpointers like this
-        //and hence the number of maximally needed copies
-
-        do
-        {
-            HazardPointer *hp = hazardPointers.load();
-            //try to recycle a free hazard pointer
-            while (hp)
-            {
-                uint32_t expectedStatus = FREE;
-                if (hp->status.compare_exchange_strong(expectedStatus, USED))
-                {
-                    auto ptr = currentObjectHazardPointer->ptr.load();
-                    do
-                    {
-                        hp->ptr.store(ptr);
-                        //is it still the same? needed, to ensure the hazard pointer is protected and no deletion in progress (when current object changes)
-                        if (currentObjectHazardPointer->ptr.compare_exchange_strong(ptr, ptr))
-                        {
-                            break;
-                        }
-                    } while (true);
-
-                    numUsedHazardPointers.fetch_add(1);
-                    return hp;
-                }
-                hp = hp->next;
-            }
-        } while (!canCreateHazardPointer.load());
-
-        //no free hazard pointer, create a new one
-        auto hp = createHazardPointer();
-        hp->status.store(USED);
-
-        auto head = hazardPointers.load();
-        do
-        {
-            hp->next = head;
-            if (hazardPointers.compare_exchange_weak(head, hp))
-            {
-                auto ptr = currentObjectHazardPointer->ptr.load();
-                do
-                {
-                    hp->ptr.store(ptr);
-                    //is it still the same? needed, to ensure the hazard pointer is protected and no deletion in progress (when current object changes)
-                    if (currentObjectHazardPointer->ptr.compare_exchange_strong(ptr, ptr))
-                    {
-                        break;
-                    }
-                } while (true);
-                break;
-            }
-
-        } while (true);
+        return Base::acquire(currentObjectPtr);
+    }
 
-        numUsedHazardPointers.fetch_add(1);
-        return hp;
+    void printHazards()
+    {
+        this->domain->print();
+    }
+};
+//atomic updates of several LockFree objects (of possibly different types)
+class MultiUpdate
+{
+public:
+    //apply f to private copies of the current objects of all wrappers and publish all new versions atomically,
+    //if any of the objects was changed concurrently nothing is published and we retry with fresh copies
+    template <typename Function, typename... Ts, typename... Allocs, typename... Policies>
+    static decltype(auto) invoke(Function &&f, LockFree<Ts, Allocs, Policies> &... wrappers)
+    {
+        static_assert(sizeof...(Ts) <= MultiUpdateDescriptor::MAX_ENTRIES, "too many objects for one multi update");
+        return invoke(std::index_sequence_for<Ts...>{}, std::forward<Function>(f), wrappers...);
     }
 
-    //expect that it is a used hazard pointer
-    void
-    releaseHazardPointer(HazardPointer &hp)
+private:
+    template <typename T, typename Alloc, typename Policy>
+    static MultiUpdateDescriptor::Entry entry(LockFree<T, Alloc, Policy> &wrapper, typename LockFree<T, Alloc, Policy>::HazardPointer *hp, T *copy)
     {
-        //we are the only writer to this hazard pointer (hence no compare exchange needed)
-        hp.status.store(RELEASED);
-        auto numReleased = numReleasedHazardPointers.fetch_add(1, std::memory_order_relaxed);
-        auto numUsed = numUsedHazardPointers.fetch_sub(1, std::memory_order_relaxed);
+        return MultiUpdateDescriptor::Entry(wrapper.currentObjectPtr, hp->template get<T>(), copy, &wrapper, hp, &finish<T, Alloc, Policy>);
+    }
 
-        constexpr double deleteScanFactor = 0.3;
-        if (numUsed * deleteScanFactor <= numReleased)
+    template <typename T, typename Alloc, typename Policy>
+    static void finish(const MultiUpdateDescriptor::Entry &entry, bool succeeded)
+    {
+        auto &wrapper = *static_cast<LockFree<T, Alloc, Policy> *>(entry.owner);
+        auto hp = static_cast<typename LockFree<T, Alloc, Policy>::HazardPointer *>(entry.hp);
+        //protected the expected object until now (it might have been reinstalled by a helper until the very end)
+        //(the update is counted by the writer, finish may run on a helper, e.g. a reader loading the object)
+        if (succeeded)
         {
-            //when enough were released (relative to those used) we atomically reset the released counter and trigger a scan
-            do
-            {
-            } while (!numReleasedHazardPointers.compare_exchange_weak(numReleased, 0));
-            deleteScan();
+            wrapper.retireHazardPointer(*hp);
+        }
+        else
+        {
+            //the copy was never visible to anyone else
+            wrapper.deallocate(reinterpret_cast<T *>(entry.desired));
+            wrapper.releaseHazardPointer(*hp);
         }
     }
 
-    //todo: can this be done in a less complicated/inefficient way without compromising lockfree robustness?
-    void deleteScan()
+    template <size_t... I, typename Function, typename... Ts, typename... Allocs, typename... Policies>
+    static decltype(auto) invoke(std::index_sequence<I...>, Function &&f, LockFree<Ts, Allocs, Policies> &... wrappers)
     {
-        deleteMutex.lock();
-        std::list<HazardPointer *> deleteCandidates;
-        std::set<T *> usedPointers;
-
+        (wrappers.waitForBacklog(), ...);
+        do
         {
-            //we can iterate over the hazard pointer list without problems (there may be added new ones in front,
-            //but they are just not considered for deletion and at least as new as currentObject
-            auto hp = hazardPointers.load();
-            while (hp)
-            {
-                uint32_t status = hp->status.load(); //this can be outdated but it does not matter
-
-                if (status == RELEASED || status == DELETE_CANDIDATE || status == READY_TO_DELETE)
-                {
-                    deleteCandidates.push_back(hp);
-                }
-                else if (status == USED) //note that it does not matter if the status became RELEASED inbetween (we just cannot free it in this scan)
-                {
-                    usedPointers.insert(hp->ptr.load());
-                }
-                hp = hp->next;
-            }
-        }
+            std::tuple<typename LockFree<Ts, Allocs, Policies>::HazardPointer *...> hps{wrappers.acquireHazardPointer()...};
+            std::tuple<Ts *...> objects{std::get<I>(hps)->template get<Ts>()...};
+            std::tuple<Ts *...> copies{wrappers.allocate(*std::get<I>(objects))...}; //local copies, protected against deletion by hps
 
-        std::list<HazardPointer *> deletableHazardPointers;
+            auto result = std::invoke(f, std::get<I>(copies)...);
 
-        //now check if we really can delete the candidates(i.e.no USED hazardpointer with the same ptr exists)
-        for (auto hp : deleteCandidates)
-        {
-            auto ptr = hp->ptr.load();
-            if (usedPointers.find(ptr) == usedPointers.end())
-            {
-                hp->updateStatus(RELEASED, DELETE_CANDIDATE);
-                deletableHazardPointers.push_back(hp);
-            }
-        }
+            //the hps may be retired by a helper, the commit hooks need their own protection of both versions
+            std::tuple<typename LockFree<Ts, Allocs, Policies>::HazardPointer *...> objectHps{wrappers.protectForHook(std::get<I>(objects))...};
+            std::tuple<typename LockFree<Ts, Allocs, Policies>::HazardPointer *...> copyHps{wrappers.protectForHook(std::get<I>(copies))...};
 
-        std::set<T *> deleteSet;
-        for (auto hp : deletableHazardPointers)
-        {
-            auto ptr = hp->ptr.load();
-            if (deleteSet.find(ptr) == deleteSet.end())
+            MultiUpdateDescriptor::Entry entries[]{entry(wrappers, std::get<I>(hps), std::get<I>(copies))...};
+            auto descriptor = MultiUpdateDescriptor::claim(entries, sizeof...(Ts));
+            bool succeeded = descriptor->execute();
+
+            //the hazard pointers are released (and the copies deallocated on failure) by the last user of the descriptor
+            descriptor->release();
+
+            if (succeeded)
             {
-                //first occurence, delete later
-                if (hp->updateStatus(DELETE_CANDIDATE, READY_TO_DELETE))
-                {
-                    deleteSet.insert(ptr);
-                }
+                (wrappers.committed(std::get<I>(objects), std::get<I>(copies), std::get<I>(copyHps)), ...);
             }
             else
             {
-                //further occurences, may be marked as free
-                hp->updateStatus(DELETE_CANDIDATE, FREE); //todo: can we just use a store?
+                (wrappers.releaseForHook(std::get<I>(copyHps)), ...);
             }
-        }
-        deleteMutex.unlock();
+            (wrappers.releaseForHook(std::get<I>(objectHps)), ...);
 
-        tryDelete();
-    }
-
-    std::mutex deleteMutex; //for testing
-#if 0
-    void tryDelete()
-    {
-        //deleteMutex.lock();
-        auto hp = hazardPointers.load();
-        while (hp)
-        {
-
-            hp->mutex.lock();
-            uint32_t status = hp->status.load();
-            while (status == READY_TO_DELETE)
+            if (succeeded)
             {
-                //not ideal, we may leak this hp if the setting thread dies (todo: find a better solution)
-                // if (hp->deletionInProgress.test_and_set())
-                // {
-                //     break;
-                // }
-
-                //exclusive access to this hp
-                //check whether it is still ready to delete
-                do
-                {
-                    if (hp->status.compare_exchange_strong(status, READY_TO_DELETE))
-                    {
-                        deallocate(hp->ptr.load());
-                        hp->updateStatus(READY_TO_DELETE, FREE);
-                        break;
-                    }
-                } while (status == READY_TO_DELETE);
-
-                // hp->deletionInProgress.clear();
+                return result;
             }
-            hp->mutex.unlock();
-
-            hp = hp->next;
-        }
-        //deleteMutex.unlock();
+        } while (true);
     }
+};
 
-#else
-    void tryDelete()
-    {
-        //deleteMutex.lock();
-        auto hp = hazardPointers.load();
-        while (hp)
-        {
-            hp->mutex.lock();
-            uint32_t status = hp->status.load();
-
-            if (status == READY_TO_DELETE)
-            {
-                deallocate(hp->ptr.load());
-                hp->status.store(FREE);
-            }
+//e.g. multiInvoke([](Index *index, Data *data) { ... }, lfIndex, lfData);
+template <typename Function, typename... Ts, typename... Allocs, typename... Policies>
+decltype(auto) multiInvoke(Function &&f, LockFree<Ts, Allocs, Policies> &... wrappers)
+{
+    return MultiUpdate::invoke(std::forward<Function>(f), wrappers...);
+}
 
-            hp->mutex.unlock();
+//read access to versions of several LockFree objects which were all current at the same time (as long as it lives)
+//e.g. auto [index, data] = snapshot(lfIndex, lfData);
+template <typename... Wrappers>
+class Snapshot
+{
+public:
+    template <typename... Ts, typename... Allocs, typename... Policies>
+    friend Snapshot<LockFree<Ts, Allocs, Policies>...> snapshot(LockFree<Ts, Allocs, Policies> &... wrappers);
 
-            hp = hp->next;
-        }
-        //deleteMutex.unlock();
+    ~Snapshot()
+    {
+        release(std::index_sequence_for<Wrappers...>{});
     }
-#endif
 
-    template <typename... Args>
-    T *allocate(Args &&... args)
+    Snapshot(const Snapshot &) = delete;
+    Snapshot(Snapshot &&) = delete;
+
+    template <size_t I>
+    const typename std::tuple_element_t<I, std::tuple<Wrappers...>>::value_type &get() const
     {
-        return Allocator::allocate<T>(std::forward<Args>(args)...);
+        return *std::get<I>(objects);
     }
 
-    void deallocate(T *p)
+private:
+    using HazardPointer = HazardDomain::HazardPointer;
+
+    std::tuple<Wrappers *...> wrappers;
+    std::array<HazardPointer *, sizeof...(Wrappers)> hps;
+    std::tuple<const typename Wrappers::value_type *...> objects;
+
+    Snapshot(Wrappers &... wrappers) : wrappers(&wrappers...)
     {
-        Allocator::free(p);
+        protect(std::index_sequence_for<Wrappers...>{});
     }
 
-    HazardPointer *createHazardPointer()
+    //all hazard pointers first, then protect the current versions until no object was updated in between
+    //(the counters show updates between the protections, the pointers show updates which were not counted yet)
+    template <size_t... I>
+    void protect(std::index_sequence<I...>)
     {
-        if (canCreateHazardPointer.load())
+        ((hps[I] = std::get<I>(wrappers)->domain->acquireForRead()), ...);
+        do
         {
-            constexpr uint32_t MAX_HAZARDS{1000}; //todo: max limit mechanism works not exact right now, but not that important for now
-            auto id = numHazardPointers.fetch_add(1);
-            if (id > MAX_HAZARDS)
+            std::array<uint64_t, sizeof...(Wrappers)> versions{std::get<I>(wrappers)->version()...};
+            ((std::get<I>(objects) = std::get<I>(wrappers)->protectCurrentObject(hps[I])), ...);
+            if (((std::get<I>(wrappers)->version() == versions[I]) && ...) &&
+                ((std::get<I>(wrappers)->currentObjectPtr.load() == std::get<I>(objects)) && ...))
             {
-                canCreateHazardPointer.store(false); //created last one
+                return;
             }
-            //can use a pool later
-            return new HazardPointer(id);
-        }
-        return nullptr;
+        } while (true);
     }
 
-    //todo: take a look at invoke and make sure it works similarly with the trywriter (there are subtle races when recycling hps)
-    bool updateObject(T *expectedObject, T *newObject)
+    template <size_t... I>
+    void release(std::index_sequence<I...>)
     {
-
-        if (currentObjectHazardPointer->ptr.compare_exchange_strong(expectedObject, newObject))
-        {
-            return true;
-        }
-        return false;
+        (std::get<I>(wrappers)->releaseHazardPointer(*hps[I]), ...);
     }
+};
 
-    void printHazards()
-    {
-        std::cout << "****************" << std::endl;
-        auto hp = hazardPointers.load();
-        while (hp)
-        {
-            hp->print();
-            hp = hp->next;
-        }
-        std::cout << "****************" << std::endl;
-    }
-};
\ No newline at end of file
+template <typename... Ts, typename... Allocs, typename... Policies>
+Snapshot<LockFree<Ts, Allocs, Policies>...> snapshot(LockFree<Ts, Allocs, Policies> &... wrappers)
+{
+    return Snapshot<LockFree<Ts, Allocs, Policies>...>(wrappers...);
+}
+
+namespace std
+{
+template <typename... Wrappers>
+struct tuple_size<Snapshot<Wrappers...>> : std::integral_constant<size_t, sizeof...(Wrappers)>
+{
+};
+
+template <size_t I, typename... Wrappers>
+struct tuple_element<I, Snapshot<Wrappers...>>
+{
+    using type = const typename std::tuple_element_t<I, std::tuple<Wrappers...>>::value_type;
+};
+} // namespace std
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+
+#include "assert.h"
+
+//descriptor based multi word compare and swap (in the spirit of Harris, Fraser and Pratt)
+//used to publish new versions of several LockFree objects atomically (all or none)
+//
+//the descriptor is installed in the current object pointer of every participating object (marked by the lowest bit)
+//anyone who encounters a descriptor helps to complete the update before using the pointer,
+//hence readers never observe a state where only some of the objects were updated
+
+class MultiUpdateDescriptor
+{
+public:
+    enum Status
+    {
+        UNDECIDED, //descriptor is (being) installed, the update may still succeed or fail
+        SUCCEEDED, //all expected values were replaced by the descriptor, new values are logically published
+        FAILED     //some object changed concurrently, expected values remain logically published
+    };
+
+    enum Phase
+    {
+        FREE,     //can be claimed for a new update
+        ACTIVE,   //owned by an update (which may be finished, but not all helpers are gone yet)
+        FINISHING //last user is cleaning up (releasing the resources held for the update)
+    };
+
+    //type erased access to the current object pointer of one participating object
+    //(a plain value with function pointers, the entries are stored in the descriptor without allocations)
+    class Entry
+    {
+    public:
+        //called exactly once after the update is decided and no helper can access the descriptor anymore
+        using Finish = void (*)(const Entry &entry, bool succeeded);
+
+        Entry() = default;
+
+        //owner and hp are only passed on to finish
+        template <typename T>
+        Entry(std::atomic<T *> &word, T *expected, T *desired, void *owner, void *hp, Finish finish)
+            : expected(reinterpret_cast<uintptr_t>(expected)), desired(reinterpret_cast<uintptr_t>(desired)), owner(owner),
+              hp(hp), address(&word), loadWord(&load<T>), compareExchangeWord(&compareExchange<T>), finishEntry(finish)
+        {
+        }
+
+        uintptr_t load() const
+        {
+            return loadWord(address);
+        }
+
+        bool compareExchange(uintptr_t expected, uintptr_t desired) const
+        {
+            return compareExchangeWord(address, expected, desired);
+        }
+
+        const void *word() const //only used for ordering
+        {
+            return address;
+        }
+
+        void finish(bool succeeded) const
+        {
+            finishEntry(*this, succeeded);
+        }
+
+        uintptr_t expected{0};
+        uintptr_t desired{0};
+        void *owner{nullptr};
+        void *hp{nullptr};
+
+    private:
+        void *address{nullptr};
+        uintptr_t (*loadWord)(void *word){nullptr};
+        bool (*compareExchangeWord)(void *word, uintptr_t expected, uintptr_t desired){nullptr};
+        Finish finishEntry{nullptr};
+
+        template <typename T>
+        static uintptr_t load(void *word)
+        {
+            return reinterpret_cast<uintptr_t>(static_cast<std::atomic<T *> *>(word)->load());
+        }
+
+        template <typename T>
+        static bool compareExchange(void *word, uintptr_t expected, uintptr_t desired)
+        {
+            auto expectedObject = reinterpret_cast<T *>(expected);
+            return static_cast<std::atomic<T *> *>(word)->compare_exchange_strong(expectedObject, reinterpret_cast<T *>(desired));
+        }
+    };
+
+    //objects updated by one multi update at most
+    static constexpr size_t MAX_ENTRIES{8};
+
+    static bool isDescriptor(uintptr_t value)
+    {
+        return (value & TAG) != 0;
+    }
+
+    template <typename T>
+    static bool isDescriptor(T *value)
+    {
+        return isDescriptor(reinterpret_cast<uintptr_t>(value));
+    }
+
+    //help to complete the update whose (tagged) descriptor was read from word
+    //afterwards the descriptor is no longer installed in word
+    template <typename T>
+    static void help(std::atomic<T *> &word, T *value)
+    {
+        helpIfInstalled(reinterpret_cast<uintptr_t>(value), [&]() { return reinterpret_cast<uintptr_t>(word.load()); });
+    }
+
+    //claim a descriptor for a new update of at most MAX_ENTRIES objects, the caller owns one reference until release()
+    static MultiUpdateDescriptor *claim(const Entry *entries, size_t numEntries)
+    {
+        assert(numEntries <= MAX_ENTRIES);
+        //descriptors are never deallocated, only recycled (type stable memory),
+        //this way helpers can safely access a descriptor they read from a word even if it was finished in between
+        //(they will notice it is no longer installed in this word)
+        //a descriptor is in use from claim until its last user released it (a helper only references it while helping),
+        //hence the pool only grows to the number of multi updates running at the same time (at most one per thread)
+        //plus the finished ones late helpers still reference
+        auto descriptor = pool().load();
+        while (descriptor)
+        {
+            if (descriptor->tryClaim())
+            {
+                break;
+            }
+            descriptor = descriptor->next;
+        }
+
+        if (!descriptor)
+        {
+            descriptor = new MultiUpdateDescriptor();
+            descriptor->tryClaim();
+            poolSize().fetch_add(1, std::memory_order_relaxed);
+            auto head = pool().load();
+            do
+            {
+                descriptor->next = head;
+            } while (!pool().compare_exchange_weak(head, descriptor));
+        }
+
+        //sorted by word to avoid cyclic helping between overlapping updates
+        auto begin = descriptor->entries.begin();
+        auto end = std::copy(entries, entries + numEntries, begin);
+        std::sort(begin, end, [](auto &a, auto &b) { return a.word() < b.word(); });
+        assert(std::adjacent_find(begin, end, [](auto &a, auto &b) { return a.word() == b.word(); }) == end);
+        descriptor->numEntries = numEntries;
+        descriptor->status.store(UNDECIDED);
+        return descriptor;
+    }
+
+    //descriptors allocated so far (they are kept for reuse until the process exits)
+    static uint64_t numDescriptors()
+    {
+        return poolSize().load(std::memory_order_relaxed);
+    }
+
+    //try to install the descriptor in all words and decide the update, returns whether the update succeeded
+    bool execute()
+    {
+        help();
+        return status.load() == SUCCEEDED;
+    }
+
+    void release()
+    {
+        //the last user of an active descriptor cleans up, this has to be decided together with the reference count
+        //(otherwise a late helper could clean up the next update using this descriptor)
+        auto oldState = state.load();
+        uint64_t newState;
+        do
+        {
+            newState = oldState - REFERENCE;
+            if (newState == ACTIVE)
+            {
+                newState = FINISHING;
+            }
+        } while (!state.compare_exchange_weak(oldState, newState));
+
+        if (newState == FINISHING)
+        {
+            bool succeeded = status.load() == SUCCEEDED;
+            for (size_t i = 0; i < numEntries; ++i)
+            {
+                entries[i].finish(succeeded);
+            }
+            numEntries = 0;
+            state.fetch_sub(FINISHING - FREE); //keep the references of late helpers
+        }
+    }
+
+    uintptr_t tagged()
+    {
+        return reinterpret_cast<uintptr_t>(this) | TAG;
+    }
+
+private:
+    static constexpr uintptr_t TAG{1}; //all objects are at least 2 byte aligned
+    static constexpr uint64_t REFERENCE{4}; //the phase is stored in the lowest two bits of the state
+
+    std::array<Entry, MAX_ENTRIES> entries;
+    size_t numEntries{0};
+    std::atomic<uint32_t> status{UNDECIDED};
+    std::atomic<uint64_t> state{FREE}; //number of references (owner and helpers) and phase
+    MultiUpdateDescriptor *next{nullptr};
+
+    MultiUpdateDescriptor() = default;
+
+    static std::atomic<MultiUpdateDescriptor *> &pool()
+    {
+        static std::atomic<MultiUpdateDescriptor *> s_pool{nullptr};
+        return s_pool;
+    }
+
+    static std::atomic<uint64_t> &poolSize()
+    {
+        static std::atomic<uint64_t> s_size{0};
+        return s_size;
+    }
+
+    static MultiUpdateDescriptor *fromTagged(uintptr_t value)
+    {
+        return reinterpret_cast<MultiUpdateDescriptor *>(value & ~TAG);
+    }
+
+    //only possible if no late helper still holds a reference
+    bool tryClaim()
+    {
+        uint64_t expectedState = FREE;
+        return state.compare_exchange_strong(expectedState, ACTIVE + REFERENCE);
+    }
+
+    template <typename Load>
+    static void helpIfInstalled(uintptr_t value, Load &&load)
+    {
+        auto descriptor = fromTagged(value);
+        descriptor->state.fetch_add(REFERENCE);
+        //only if it is still installed we know it belongs to the update we encountered (and its entries are valid)
+        if (load() == value)
+        {
+            descriptor->help();
+        }
+        descriptor->release();
+    }
+
+    //requires a reference to the descriptor
+    void help()
+    {
+        //phase 1: install the descriptor in all words in order
+        uint32_t decision = SUCCEEDED;
+        for (size_t i = 0; i < numEntries; ++i)
+        {
+            auto &entry = entries[i];
+            do
+            {
+                if (status.load() != UNDECIDED)
+                {
+                    break;
+                }
+
+                auto value = entry.load();
+                if (value == tagged())
+                {
+                    break;
+                }
+
+                if (isDescriptor(value))
+                {
+                    helpIfInstalled(value, [&]() { return entry.load(); });
+                    continue;
+                }
+
+                if (value != entry.expected)
+                {
+                    decision = FAILED;
+                    break;
+                }
+
+                //we might install the descriptor after the update was decided by someone else
+                //this is fine since we remove it ourselves in phase 2 (and hold a reference until then)
+                if (entry.compareExchange(value, tagged()))
+                {
+                    break;
+                }
+            } while (true);
+
+            if (decision == FAILED)
+            {
+                break;
+            }
+        }
+
+        uint32_t expectedStatus = UNDECIDED;
+        status.compare_exchange_strong(expectedStatus, decision);
+
+        //phase 2: replace the descriptor by the logical value in all words
+        bool succeeded = status.load() == SUCCEEDED;
+        for (size_t i = 0; i < numEntries; ++i)
+        {
+            auto &entry = entries[i];
+            entry.compareExchange(tagged(), succeeded ? entry.desired : entry.expected);
+        }
+    }
+};
@@ -0,0 +1,347 @@
+#pragma once
+#include "lockfree_wrapper.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+//persistent hash map (hash array mapped trie): copies share all nodes and are O(1),
+//an update copies only the path to the changed key (O(log n)), hence it is cheap to wrap in LockFree
+//
+//nodes are reference counted (atomically, versions are copied and deleted concurrently) and allocated with Alloc
+//they are immutable once they are reachable from more than one version, a version itself is not thread safe
+//(as any object in LockFree, it is only changed while it is a private copy)
+
+template <typename K, typename V, typename Hash = std::hash<K>, typename Alloc = Allocator>
+class PersistentMap
+{
+private:
+    static constexpr uint32_t BITS{5}; //of the hash per level, i.e. 32 children at most
+    static constexpr uint32_t MASK{(1u << BITS) - 1};
+
+    struct Node
+    {
+        Node(bool leaf, size_t hash = 0) : leaf(leaf), hash(hash)
+        {
+        }
+
+        std::atomic<uint32_t> references{1};
+        const bool leaf;
+        const size_t hash;                    //leaf: hash of all its keys
+        uint32_t bitmap{0};                   //branch: occupied slots
+        std::vector<Node *> children;         //branch: one child per occupied slot (in slot order)
+        std::vector<std::pair<K, V>> entries; //leaf: keys with the same hash (usually one)
+    };
+
+public:
+    PersistentMap(Alloc allocator = Alloc()) : allocator(std::move(allocator))
+    {
+    }
+
+    PersistentMap(const PersistentMap &other) : allocator(other.allocator), root(retain(other.root)), count(other.count)
+    {
+    }
+
+    PersistentMap &operator=(const PersistentMap &other)
+    {
+        auto newRoot = retain(other.root);
+        release(root);
+        allocator = other.allocator;
+        root = newRoot;
+        count = other.count;
+        return *this;
+    }
+
+    ~PersistentMap()
+    {
+        release(root);
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    //nullptr if key is not in the map, valid as long as this version is not changed
+    const V *find(const K &key) const
+    {
+        auto hash = Hash()(key);
+        uint32_t shift = 0;
+        auto node = root;
+        while (node)
+        {
+            if (node->leaf)
+            {
+                auto entry = node->hash == hash ? find(node->entries, key) : nullptr;
+                return entry ? &entry->second : nullptr;
+            }
+
+            uint32_t bit = 1u << ((hash >> shift) & MASK);
+            if (!(node->bitmap & bit))
+            {
+                return nullptr;
+            }
+            node = node->children[position(node->bitmap, bit)];
+            shift += BITS;
+        }
+        return nullptr;
+    }
+
+    bool contains(const K &key) const
+    {
+        return find(key) != nullptr;
+    }
+
+    //insert or assign
+    void set(const K &key, const V &value)
+    {
+        bool added = false;
+        auto newRoot = set(root, 0, Hash()(key), key, value, added);
+        release(root);
+        root = newRoot;
+        count += added;
+    }
+
+    //returns false if the key was not in the map
+    bool erase(const K &key)
+    {
+        bool removed = false;
+        auto newRoot = erase(root, 0, Hash()(key), key, removed);
+        if (removed)
+        {
+            release(root);
+            root = newRoot;
+            --count;
+        }
+        return removed;
+    }
+
+    //f(key, value) for all entries (in no particular order)
+    template <typename Function>
+    void forEach(Function &&f) const
+    {
+        forEach(root, f);
+    }
+
+private:
+    Alloc allocator;
+    Node *root{nullptr};
+    size_t count{0};
+
+    static uint32_t position(uint32_t bitmap, uint32_t bit)
+    {
+        return __builtin_popcount(bitmap & (bit - 1));
+    }
+
+    template <typename Entries>
+    static auto find(Entries &entries, const K &key) -> decltype(&entries[0])
+    {
+        for (auto &entry : entries)
+        {
+            if (entry.first == key)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    static Node *retain(Node *node)
+    {
+        if (node)
+        {
+            node->references.fetch_add(1, std::memory_order_relaxed);
+        }
+        return node;
+    }
+
+    void release(Node *node)
+    {
+        if (node && node->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            for (auto child : node->children)
+            {
+                release(child);
+            }
+            allocator.free(node);
+        }
+    }
+
+    Node *leaf(size_t hash, const K &key, const V &value)
+    {
+        auto node = allocator.template allocate<Node>(true, hash);
+        node->entries.emplace_back(key, value);
+        return node;
+    }
+
+    //the copy shares all children with node
+    Node *copy(const Node *node)
+    {
+        auto copy = allocator.template allocate<Node>(node->leaf, node->hash);
+        copy->bitmap = node->bitmap;
+        copy->children = node->children;
+        copy->entries = node->entries;
+        for (auto child : copy->children)
+        {
+            retain(child);
+        }
+        return copy;
+    }
+
+    //branches until the (different) hashes of both leafs differ at some level, takes ownership of both
+    Node *merge(Node *a, Node *b, uint32_t shift)
+    {
+        auto branch = allocator.template allocate<Node>(false);
+        uint32_t slotA = (a->hash >> shift) & MASK;
+        uint32_t slotB = (b->hash >> shift) & MASK;
+        if (slotA == slotB)
+        {
+            branch->bitmap = 1u << slotA;
+            branch->children.push_back(merge(a, b, shift + BITS));
+        }
+        else
+        {
+            branch->bitmap = (1u << slotA) | (1u << slotB);
+            branch->children = slotA < slotB ? std::vector<Node *>{a, b} : std::vector<Node *>{b, a};
+        }
+        return branch;
+    }
+
+    //returns the new version of node (path copy), node itself is not changed
+    Node *set(Node *node, uint32_t shift, size_t hash, const K &key, const V &value, bool &added)
+    {
+        if (!node)
+        {
+            added = true;
+            return leaf(hash, key, value);
+        }
+
+        if (node->leaf)
+        {
+            if (node->hash != hash)
+            {
+                added = true;
+                return merge(retain(node), leaf(hash, key, value), shift);
+            }
+
+            auto newNode = copy(node);
+            auto entry = find(newNode->entries, key);
+            if (entry)
+            {
+                entry->second = value;
+            }
+            else
+            {
+                added = true;
+                newNode->entries.emplace_back(key, value);
+            }
+            return newNode;
+        }
+
+        uint32_t bit = 1u << ((hash >> shift) & MASK);
+        auto index = position(node->bitmap, bit);
+        auto newNode = copy(node);
+        if (node->bitmap & bit)
+        {
+            auto child = set(node->children[index], shift + BITS, hash, key, value, added);
+            release(newNode->children[index]);
+            newNode->children[index] = child;
+        }
+        else
+        {
+            added = true;
+            newNode->bitmap |= bit;
+            newNode->children.insert(newNode->children.begin() + index, leaf(hash, key, value));
+        }
+        return newNode;
+    }
+
+    //returns the new version of node if key was removed (nullptr if it is empty now)
+    Node *erase(Node *node, uint32_t shift, size_t hash, const K &key, bool &removed)
+    {
+        if (!node)
+        {
+            return nullptr;
+        }
+
+        if (node->leaf)
+        {
+            if (node->hash != hash || !find(node->entries, key))
+            {
+                return nullptr;
+            }
+            removed = true;
+            if (node->entries.size() == 1)
+            {
+                return nullptr;
+            }
+            auto newNode = copy(node);
+            auto entry = find(newNode->entries, key);
+            *entry = std::move(newNode->entries.back());
+            newNode->entries.pop_back();
+            return newNode;
+        }
+
+        uint32_t bit = 1u << ((hash >> shift) & MASK);
+        if (!(node->bitmap & bit))
+        {
+            return nullptr;
+        }
+        auto index = position(node->bitmap, bit);
+        auto child = erase(node->children[index], shift + BITS, hash, key, removed);
+        if (!removed)
+        {
+            return nullptr;
+        }
+
+        //a branch containing only a leaf is replaced by the leaf (lookups compare the hash of leafs at any level)
+        auto size = node->children.size();
+        if (!child)
+        {
+            if (size == 1)
+            {
+                return nullptr;
+            }
+            if (size == 2 && node->children[1 - index]->leaf)
+            {
+                return retain(node->children[1 - index]);
+            }
+        }
+        else if (size == 1 && child->leaf)
+        {
+            return child;
+        }
+
+        auto newNode = copy(node);
+        release(newNode->children[index]);
+        if (child)
+        {
+            newNode->children[index] = child;
+        }
+        else
+        {
+            newNode->bitmap &= ~bit;
+            newNode->children.erase(newNode->children.begin() + index);
+        }
+        return newNode;
+    }
+
+    template <typename Function>
+    static void forEach(const Node *node, Function &f)
+    {
+        if (!node)
+        {
+            return;
+        }
+        for (auto &entry : node->entries)
+        {
+            f(entry.first, entry.second);
+        }
+        for (auto child : node->children)
+        {
+            forEach(child, f);
+        }
+    }
+};
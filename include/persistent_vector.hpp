@@ -0,0 +1,287 @@
+#pragma once
+#include "lockfree_wrapper.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "assert.h"
+
+//persistent vector (radix balanced trie, 32 elements per leaf): copies share all nodes and are O(1),
+//set, push_back and pop_back copy only the path to the changed element (O(log n))
+//
+//nodes are reference counted and allocated with Alloc like the nodes of PersistentMap
+
+template <typename T, typename Alloc = Allocator>
+class PersistentVector
+{
+private:
+    static constexpr uint32_t BITS{5};
+    static constexpr uint32_t WIDTH{1u << BITS};
+    static constexpr uint32_t MASK{WIDTH - 1};
+
+    //all nodes are full except those on the path to the last element
+    struct Node
+    {
+        std::atomic<uint32_t> references{1};
+        std::vector<Node *> children; //branch
+        std::vector<T> values;        //leaf
+    };
+
+public:
+    PersistentVector(Alloc allocator = Alloc()) : allocator(std::move(allocator))
+    {
+    }
+
+    PersistentVector(const PersistentVector &other)
+        : allocator(other.allocator), root(retain(other.root)), shift(other.shift), count(other.count)
+    {
+    }
+
+    PersistentVector &operator=(const PersistentVector &other)
+    {
+        auto newRoot = retain(other.root);
+        release(root);
+        allocator = other.allocator;
+        root = newRoot;
+        shift = other.shift;
+        count = other.count;
+        return *this;
+    }
+
+    ~PersistentVector()
+    {
+        release(root);
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    const T &operator[](size_t index) const
+    {
+        assert(index < count);
+        auto node = root;
+        for (auto level = shift; level > 0; level -= BITS)
+        {
+            node = node->children[(index >> level) & MASK];
+        }
+        return node->values[index & MASK];
+    }
+
+    void set(size_t index, const T &value)
+    {
+        assert(index < count);
+        auto newRoot = set(root, shift, index, value);
+        release(root);
+        root = newRoot;
+    }
+
+    void push_back(const T &value)
+    {
+        if (!root)
+        {
+            root = path(0, value);
+        }
+        else if (count == (size_t(WIDTH) << shift))
+        {
+            //full, the tree grows by one level (the new root takes over our reference of the old one)
+            auto newRoot = allocator.template allocate<Node>();
+            newRoot->children.push_back(root);
+            newRoot->children.push_back(path(shift, value));
+            root = newRoot;
+            shift += BITS;
+        }
+        else
+        {
+            auto newRoot = push(root, shift, count, value);
+            release(root);
+            root = newRoot;
+        }
+        ++count;
+    }
+
+    void pop_back()
+    {
+        assert(count > 0);
+        auto newRoot = pop(root, shift, count - 1);
+        release(root);
+        root = newRoot;
+        --count;
+
+        //a root with a single child is not needed (unless it is a leaf)
+        if (root && shift > 0 && root->children.size() == 1)
+        {
+            auto child = retain(root->children[0]);
+            release(root);
+            root = child;
+            shift -= BITS;
+        }
+        if (!root)
+        {
+            shift = 0;
+        }
+    }
+
+    //f(value) for all elements in order
+    template <typename Function>
+    void forEach(Function &&f) const
+    {
+        forEach(root, f);
+    }
+
+private:
+    Alloc allocator;
+    Node *root{nullptr};
+    uint32_t shift{0}; //of the index bits at the root, 0 if the root is a leaf
+    size_t count{0};
+
+    static Node *retain(Node *node)
+    {
+        if (node)
+        {
+            node->references.fetch_add(1, std::memory_order_relaxed);
+        }
+        return node;
+    }
+
+    void release(Node *node)
+    {
+        if (node && node->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            for (auto child : node->children)
+            {
+                release(child);
+            }
+            allocator.free(node);
+        }
+    }
+
+    //the copy shares all children with node
+    Node *copy(const Node *node)
+    {
+        auto copy = allocator.template allocate<Node>();
+        copy->children = node->children;
+        copy->values = node->values;
+        for (auto child : copy->children)
+        {
+            retain(child);
+        }
+        return copy;
+    }
+
+    //new nodes down to a leaf containing only value
+    Node *path(uint32_t level, const T &value)
+    {
+        auto node = allocator.template allocate<Node>();
+        if (level == 0)
+        {
+            node->values.reserve(WIDTH);
+            node->values.push_back(value);
+        }
+        else
+        {
+            node->children.push_back(path(level - BITS, value));
+        }
+        return node;
+    }
+
+    Node *set(const Node *node, uint32_t level, size_t index, const T &value)
+    {
+        auto newNode = copy(node);
+        if (level == 0)
+        {
+            newNode->values[index & MASK] = value;
+        }
+        else
+        {
+            auto slot = (index >> level) & MASK;
+            auto child = set(node->children[slot], level - BITS, index, value);
+            release(newNode->children[slot]);
+            newNode->children[slot] = child;
+        }
+        return newNode;
+    }
+
+    //index is the new last index, it is below the capacity of node
+    Node *push(const Node *node, uint32_t level, size_t index, const T &value)
+    {
+        auto newNode = copy(node);
+        if (level == 0)
+        {
+            newNode->values.push_back(value);
+        }
+        else
+        {
+            auto slot = (index >> level) & MASK;
+            if (slot < node->children.size())
+            {
+                auto child = push(node->children[slot], level - BITS, index, value);
+                release(newNode->children[slot]);
+                newNode->children[slot] = child;
+            }
+            else
+            {
+                newNode->children.push_back(path(level - BITS, value));
+            }
+        }
+        return newNode;
+    }
+
+    //removes the last element (at index), returns nullptr if node is empty afterwards
+    Node *pop(const Node *node, uint32_t level, size_t index)
+    {
+        if (level == 0)
+        {
+            if (node->values.size() == 1)
+            {
+                return nullptr;
+            }
+            auto newNode = copy(node);
+            newNode->values.pop_back();
+            return newNode;
+        }
+
+        auto slot = (index >> level) & MASK;
+        auto child = pop(node->children[slot], level - BITS, index);
+        if (!child && slot == 0)
+        {
+            return nullptr;
+        }
+
+        auto newNode = copy(node);
+        release(newNode->children[slot]);
+        if (child)
+        {
+            newNode->children[slot] = child;
+        }
+        else
+        {
+            newNode->children.pop_back();
+        }
+        return newNode;
+    }
+
+    template <typename Function>
+    static void forEach(const Node *node, Function &f)
+    {
+        if (!node)
+        {
+            return;
+        }
+        for (auto &value : node->values)
+        {
+            f(value);
+        }
+        for (auto child : node->children)
+        {
+            forEach(child, f);
+        }
+    }
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include "lockfree_wrapper.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+//throughput of LockFree<T, Alloc, P> for every policy P in AllPolicies:
+//writers call update(object) and readers read(object), iterations times each
+//every policy runs numWriters + numReaders threads, without readOnly the readers update as well,
+//the rates are reported per role (operations of the role / time until its last thread finished)
+
+template <typename T, typename Alloc, typename P, typename Update, typename Read>
+void benchmarkPolicy(Update &update, Read &read, int iterations, int numWriters, int numReaders)
+{
+    if constexpr (!P::Proxies::readOnly)
+    {
+        numWriters += numReaders;
+        numReaders = 0;
+    }
+
+    LockFree<T, Alloc, P> object;
+    std::vector<std::thread> threads;
+    std::vector<std::chrono::steady_clock::time_point> ends(numWriters + numReaders);
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < numWriters; ++i)
+    {
+        threads.emplace_back([&, i]() {
+            for (int j = 0; j < iterations; ++j)
+            {
+                update(object);
+            }
+            ends[i] = std::chrono::steady_clock::now();
+        });
+    }
+    if constexpr (P::Proxies::readOnly)
+    {
+        for (int i = numWriters; i < numWriters + numReaders; ++i)
+        {
+            threads.emplace_back([&, i]() {
+                for (int j = 0; j < iterations; ++j)
+                {
+                    read(object);
+                }
+                ends[i] = std::chrono::steady_clock::now();
+            });
+        }
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    //operations per second of the threads [first, last)
+    auto rate = [&](int first, int last) -> uint64_t {
+        if (first == last)
+        {
+            return 0;
+        }
+        std::chrono::duration<double> seconds = *std::max_element(ends.begin() + first, ends.begin() + last) - start;
+        return uint64_t(double(last - first) * iterations / seconds.count());
+    };
+    std::cout << "policy " << policyName<P>() << " writers " << numWriters << " readers " << numReaders << " writes/s "
+              << rate(0, numWriters) << " reads/s " << rate(numWriters, numWriters + numReaders) << std::endl;
+}
+
+template <typename T, typename Alloc, typename Update, typename Read, typename... Ps>
+void benchmarkPolicies(std::tuple<Ps...> *, Update &update, Read &read, int iterations, int numWriters, int numReaders)
+{
+    (benchmarkPolicy<T, Alloc, Ps>(update, read, iterations, numWriters, numReaders), ...);
+}
+
+template <typename T, typename Alloc = Allocator, typename Update, typename Read>
+void benchmarkPolicies(Update update, Read read, int iterations, int numWriters, int numReaders)
+{
+    benchmarkPolicies<T, Alloc>(static_cast<AllPolicies *>(nullptr), update, read, iterations, numWriters, numReaders);
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include "lockfree_wrapper.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//for objects whose state is only ever merged (counters, histograms, sets ...)
+//every thread updates its own independently wrapped shard, hence writers do not contend on a single current object
+//readers get the merged view of all shards, which is cached until a shard changes
+//the cached view only references the merged object, hence replacing it copies the shard versions but not the object,
+//and it is only replaced by a view containing at least the same shard versions
+//
+//Merge must be default constructible and callable as merge(T &result, const T &shard),
+//the initial object of every shard has to be neutral w.r.t. merging (e.g. 0 for counters)
+//every shard default constructs its own Alloc (i.e. with ArenaAllocator all shards use the shared default arena)
+
+template <typename T, typename Merge, typename Alloc = Allocator>
+class ShardedLockFree
+{
+private:
+    //one cache line each, otherwise the shards would contend again
+    struct alignas(64) Shard
+    {
+        Shard(const T &initial) : object(initial)
+        {
+        }
+
+        LockFree<T, Alloc> object;
+        std::atomic<uint64_t> version{0}; //incremented after each update, only needed for caching
+    };
+
+    struct View
+    {
+        std::vector<uint64_t> versions; //versions of the shards the merged object contains (at least)
+        std::shared_ptr<const T> merged; //shared by the copies of the view, never changed after publishing
+
+        //whether this view contains all updates of the given shard versions
+        bool contains(const std::vector<uint64_t> &shardVersions) const
+        {
+            return std::equal(versions.begin(), versions.end(), shardVersions.begin(), std::greater_equal<uint64_t>());
+        }
+    };
+
+public:
+    ShardedLockFree(uint32_t numShards = std::thread::hardware_concurrency(), const T &initial = T(), bool cached = true)
+        : initial(initial), cached(cached), cache(View{std::vector<uint64_t>(std::max(numShards, 1u), 0), std::make_shared<const T>(initial)})
+    {
+        numShards = std::max(numShards, 1u);
+        shards.reserve(numShards);
+        for (uint32_t i = 0; i < numShards; ++i)
+        {
+            shards.emplace_back(new Shard(initial));
+        }
+    }
+
+    ShardedLockFree(const ShardedLockFree &) = delete;
+    ShardedLockFree(ShardedLockFree &&) = delete;
+
+    //only changes the shard of the calling thread
+    template <typename Function, typename... Params>
+    decltype(auto) invoke(Function &&f, Params &&... params)
+    {
+        auto &shard = localShard();
+        decltype(auto) result = shard.object.invoke(std::forward<Function>(f), std::forward<Params>(params)...);
+        if (cached)
+        {
+            shard.version.fetch_add(1, std::memory_order_release);
+        }
+        return result;
+    }
+
+    //merged copy of all shards, contains at least all updates completed before the call
+    T read()
+    {
+        if (!cached)
+        {
+            return merge();
+        }
+
+        std::vector<uint64_t> versions;
+        versions.reserve(shards.size());
+        for (auto &shard : shards)
+        {
+            versions.push_back(shard->version.load(std::memory_order_acquire));
+        }
+
+        {
+            auto view = cache.readOnly();
+            if (view->contains(versions))
+            {
+                return *view->merged;
+            }
+        }
+
+        //the shards changed, merge again (after we read the versions, hence the result is at least as new)
+        //published unless a concurrent reader published a view containing our versions meanwhile
+        auto merged = std::make_shared<const T>(merge());
+        cache.invokeIf([&](const View &view) { return !view.contains(versions); },
+                       [&](View *view) {
+                           view->versions = versions;
+                           view->merged = merged;
+                       });
+        return *merged;
+    }
+
+    //number of merges published to the cache
+    uint64_t numMerges() const
+    {
+        return cache.version();
+    }
+
+    uint32_t numShards() const
+    {
+        return shards.size();
+    }
+
+private:
+    const T initial;
+    const bool cached;
+    std::vector<std::unique_ptr<Shard>> shards;
+    LockFree<View, Alloc> cache;
+
+    T merge()
+    {
+        T merged(initial);
+        Merge merger;
+        for (auto &shard : shards)
+        {
+            auto reader = shard->object.readOnly();
+            merger(merged, *reader);
+        }
+        return merged;
+    }
+
+    //threads are assigned round robin to the shards on first use (i.e. groups of threads share a shard
+    //if there are more threads than shards), this is stable as opposed to the cpu a thread is running on
+    Shard &localShard()
+    {
+        static std::atomic<uint32_t> s_nextThread{0};
+        thread_local uint32_t t_thread = s_nextThread.fetch_add(1, std::memory_order_relaxed);
+        return *shards[t_thread % shards.size()];
+    }
+};
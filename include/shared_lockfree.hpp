@@ -0,0 +1,348 @@
+#pragma once
+#include "version_state.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//LockFree object shared by processes: the current version, the hazard slots and all versions are in a named
+//shared memory segment (shm_open), every process attaching to the same name sees the same object
+//
+//nothing in the segment is a pointer (the segment is mapped at different addresses), versions are referred to by
+//their index in the segment and T must be trivially copyable (no pointers into the memory of one process)
+//
+//versions are a fixed array in the segment, a version is free again once it was replaced and no slot protects it
+//with MaxVersions > 2 * MaxSlots there is always a free version after reclaiming (every slot protects at most one
+//version, every writer holding a slot writes at most one), hence invoke never fails
+//
+//slots and versions of processes which died (e.g. crashed while reading or writing) are recovered by recover(),
+//which is also called when a process cannot get a slot or a version (pids may be reused by then, a slot of a new process
+//with the pid of a dead one is not recovered until that process exits as well)
+//a process which died while initializing the segment is replaced by the next process attaching to it
+//
+//membarrier based fences only order the threads of one process, hence readers use a full fence here
+
+template <typename T, uint32_t MaxSlots = 64, uint32_t MaxVersions = 2 * MaxSlots + 2>
+class SharedLockFree
+{
+    static_assert(std::is_trivially_copyable<T>::value, "T is copied between processes");
+    static_assert(MaxVersions > 2 * MaxSlots, "not enough versions for all slots");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<int32_t>::is_always_lock_free,
+                  "atomics in shared memory must be lock free");
+
+    static constexpr uint32_t NONE{~0u};
+    static constexpr int32_t RECOVERING{-1};
+
+    struct alignas(64) Slot
+    {
+        std::atomic<int32_t> pid{0};       //process using the slot, 0 if free
+        std::atomic<uint32_t> hazard{NONE}; //index of the protected version
+    };
+
+    //the state of a version with the pid of the process writing it (only while WRITING)
+    struct alignas(64) Version
+    {
+        std::atomic<uint64_t> state{VersionState::FREE};
+        T value;
+    };
+
+    //with the pid of the initializing process (only while INITIALIZING)
+    enum SegmentState : uint64_t
+    {
+        UNINITIALIZED, //zero filled by ftruncate
+        INITIALIZING,
+        READY
+    };
+
+    struct Segment
+    {
+        std::atomic<uint64_t> state;
+        alignas(64) std::atomic<uint32_t> current; //the publication word
+        Slot slots[MaxSlots];
+        Version versions[MaxVersions];
+    };
+
+public:
+    class ReadOnlyProxy
+    {
+    public:
+        friend class SharedLockFree;
+
+        ~ReadOnlyProxy()
+        {
+            owner->releaseSlot(slot);
+        }
+
+        const T *operator->()
+        {
+            return object;
+        }
+
+        const T &operator*()
+        {
+            return *object;
+        }
+
+    private:
+        SharedLockFree *owner;
+        uint32_t slot;
+        const T *object;
+
+        ReadOnlyProxy(SharedLockFree *owner, uint32_t slot, const T *object) : owner(owner), slot(slot), object(object)
+        {
+        }
+    };
+
+    //attach to the segment name (e.g. "/config") or create it with T(args...) as the first version
+    template <typename... Args>
+    SharedLockFree(const std::string &name, Args &&... args) : pid(getpid())
+    {
+        auto fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+        }
+        //every process sets the same size, the content is only zero filled when the segment is created
+        if (ftruncate(fd, sizeof(Segment)) != 0)
+        {
+            auto error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "ftruncate " + name);
+        }
+        auto address = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (address == MAP_FAILED)
+        {
+            throw std::system_error(errno, std::generic_category(), "mmap " + name);
+        }
+        segment = static_cast<Segment *>(address);
+
+        auto state = segment->state.load(std::memory_order_acquire);
+        while (state != READY)
+        {
+            //not initialized yet or by a process which died (then we start over, otherwise we wait for it)
+            if ((state == UNINITIALIZED || !alive(int32_t(state >> 32))) &&
+                segment->state.compare_exchange_strong(state, uint64_t(uint32_t(pid)) << 32 | INITIALIZING))
+            {
+                initialize(std::forward<Args>(args)...);
+                return;
+            }
+            sched_yield();
+            state = segment->state.load(std::memory_order_acquire);
+        }
+    }
+
+    //the segment stays until it is removed with unlink
+    ~SharedLockFree()
+    {
+        munmap(segment, sizeof(Segment));
+    }
+
+    SharedLockFree(const SharedLockFree &) = delete;
+    SharedLockFree(SharedLockFree &&) = delete;
+
+    //processes already attached keep using the segment
+    static void unlink(const std::string &name)
+    {
+        shm_unlink(name.c_str());
+    }
+
+    ReadOnlyProxy readOnly()
+    {
+        auto slot = acquireSlot();
+        auto index = protect(slot);
+        return ReadOnlyProxy(this, slot, &segment->versions[index].value);
+    }
+
+    //like LockFree::invoke, the copy is written in a free version of the segment
+    template <typename Function, typename... Params>
+    decltype(auto) invoke(Function &&f, Params &&... params)
+    {
+        auto slot = acquireSlot();
+        do
+        {
+            auto index = protect(slot);
+            uint64_t writing;
+            auto copyIndex = allocateVersion(writing);
+            auto &copy = segment->versions[copyIndex];
+            copy.value = segment->versions[index].value;
+
+            auto result = std::invoke(f, &copy.value, params...);
+
+            if (segment->current.compare_exchange_strong(index, copyIndex))
+            {
+                //the copy may already be replaced and retired, the replaced version is protected by slot
+                VersionState::publish(copy.state, writing);
+                VersionState::retire(segment->versions[index].state);
+                releaseSlot(slot);
+                return result;
+            }
+
+            VersionState::abandon(copy.state, writing);
+        } while (true);
+    }
+
+    //free the slots and versions still held by processes which do not exist anymore
+    void recover()
+    {
+        for (auto &slot : segment->slots)
+        {
+            auto owner = slot.pid.load();
+            if (owner > 0 && !alive(owner) && slot.pid.compare_exchange_strong(owner, RECOVERING))
+            {
+                slot.hazard.store(NONE);
+                slot.pid.store(0);
+            }
+        }
+        //the state is loaded before the current version: a version which is published (or current) and not current
+        //afterwards was replaced in the life we saw (every transition below only applies to that life)
+        for (uint32_t index = 0; index < MaxVersions; ++index)
+        {
+            auto &version = segment->versions[index];
+            auto state = version.state.load();
+            auto kind = VersionState::kind(state);
+            if (kind == VersionState::WRITING && !alive(int32_t(VersionState::owner(state))))
+            {
+                //published before the writer died or not (then it cannot become current anymore)
+                VersionState::tryChange(version.state, state,
+                                        segment->current.load() == index ? VersionState::PUBLISHED : VersionState::RETIRED);
+            }
+            else if (kind == VersionState::PUBLISHED && segment->current.load() != index)
+            {
+                //replaced by a writer which died before retiring it (or is about to retire it, which is the same)
+                VersionState::tryChange(version.state, state, VersionState::RETIRED);
+            }
+        }
+    }
+
+    //free all retired versions which are not protected anymore
+    void reclaim()
+    {
+        //candidates first, a version retired later may be protected by a slot we already checked
+        bool candidate[MaxVersions];
+        uint64_t retired[MaxVersions];
+        for (uint32_t index = 0; index < MaxVersions; ++index)
+        {
+            retired[index] = segment->versions[index].state.load();
+            candidate[index] = VersionState::kind(retired[index]) == VersionState::RETIRED;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (auto &slot : segment->slots)
+        {
+            auto index = slot.hazard.load();
+            if (index < MaxVersions)
+            {
+                candidate[index] = false;
+            }
+        }
+        for (uint32_t index = 0; index < MaxVersions; ++index)
+        {
+            //nothing to destroy, it is free right away (a process dying in between cannot leave it claimed)
+            if (candidate[index])
+            {
+                VersionState::tryChange(segment->versions[index].state, retired[index], VersionState::FREE);
+            }
+        }
+    }
+
+private:
+    Segment *segment;
+    const int32_t pid;
+
+    static bool alive(int32_t pid)
+    {
+        return kill(pid, 0) == 0 || errno != ESRCH;
+    }
+
+    //no other process uses the segment before it is ready, a previous attempt of a dead process is overwritten
+    template <typename... Args>
+    void initialize(Args &&... args)
+    {
+        for (auto &slot : segment->slots)
+        {
+            slot.pid.store(0, std::memory_order_relaxed);
+            slot.hazard.store(NONE, std::memory_order_relaxed);
+        }
+        for (auto &version : segment->versions)
+        {
+            version.state.store(VersionState::FREE, std::memory_order_relaxed);
+        }
+        auto &version = segment->versions[0];
+        new (&version.value) T(std::forward<Args>(args)...);
+        version.state.store(VersionState::PUBLISHED, std::memory_order_relaxed);
+        segment->current.store(0, std::memory_order_relaxed);
+        segment->state.store(READY, std::memory_order_release);
+    }
+
+    uint32_t acquireSlot()
+    {
+        thread_local uint32_t t_hint{0}; //usually the slot of this thread is free again
+        do
+        {
+            for (uint32_t i = 0; i < MaxSlots; ++i)
+            {
+                auto index = (t_hint + i) % MaxSlots;
+                int32_t expected = 0;
+                if (segment->slots[index].pid.compare_exchange_strong(expected, pid))
+                {
+                    t_hint = index;
+                    return index;
+                }
+            }
+            recover(); //all slots in use, maybe by processes which died
+            sched_yield();
+        } while (true);
+    }
+
+    void releaseSlot(uint32_t slot)
+    {
+        segment->slots[slot].hazard.store(NONE, std::memory_order_release);
+        segment->slots[slot].pid.store(0, std::memory_order_release);
+    }
+
+    //the index of the current version, protected by slot
+    uint32_t protect(uint32_t slot)
+    {
+        auto &hazard = segment->slots[slot].hazard;
+        auto index = segment->current.load();
+        do
+        {
+            hazard.store(index); //seq_cst, the fence of the scan may be in another process
+            auto current = segment->current.load();
+            if (current == index)
+            {
+                return index;
+            }
+            index = current;
+        } while (true);
+    }
+
+    uint32_t allocateVersion(uint64_t &writing)
+    {
+        do
+        {
+            for (uint32_t index = 0; index < MaxVersions; ++index)
+            {
+                writing = VersionState::tryAllocate(segment->versions[index].state, uint32_t(pid));
+                if (writing)
+                {
+                    return index;
+                }
+            }
+            reclaim();
+            recover();
+        } while (true);
+    }
+};
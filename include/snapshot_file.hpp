@@ -0,0 +1,384 @@
+#pragma once
+#include "lockfree_wrapper.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//durable snapshots of a LockFree object in a memory mapped file, written by a background thread
+//
+//the thread protects the current version with a hazard pointer and serializes it directly into the mapping,
+//i.e. writers are never blocked and there is no extra copy (the version is only kept until it is serialized)
+//
+//the file keeps the last two snapshots, a snapshot is written next to the last durable one and only becomes the last
+//one after its data was synced (msync), hence a crash while writing leaves the previous snapshot
+//
+//every snapshot is persisted with the version() of the object, the snapshot contains at least that many updates
+//(updates which were published but not counted yet when it was taken may be contained as well)
+//
+//file: header page with two records (sequence, version, offset, size, checksum), snapshot data at the offsets
+//(the sequence only orders the snapshots of the file, versions start again at 0 with a restored object)
+//the checksum covers the other fields of the record and the data, a record torn by a crash is invalid
+
+template <typename T, typename Alloc = Allocator, typename Policy = DefaultPolicy>
+class SnapshotFile
+{
+public:
+    //writes the serialized object to buffer if it fits into capacity, returns the size needed in any case
+    //(it is called again with a larger buffer if the size exceeds capacity)
+    using Serializer = std::function<size_t(const T &object, char *buffer, size_t capacity)>;
+
+    SnapshotFile(LockFree<T, Alloc, Policy> &object, const std::string &path, Serializer serializer)
+        : object(object), serializer(std::move(serializer))
+    {
+        fd = open(path.c_str(), O_CREAT | O_RDWR, 0600);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+
+        struct stat status;
+        if (fstat(fd, &status) != 0)
+        {
+            auto error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "fstat " + path);
+        }
+        if (size_t(status.st_size) < HEADER_SIZE || !remap(status.st_size))
+        {
+            if (!remap(HEADER_SIZE))
+            {
+                auto error = errno;
+                close(fd);
+                throw std::system_error(error, std::generic_category(), "mmap " + path);
+            }
+        }
+
+        //continue after the snapshots of a previous run
+        if (header()->magic != MAGIC)
+        {
+            *header() = Header();
+        }
+        else if (auto last = latest(data, mappingSize))
+        {
+            lastRecord = last - header()->records;
+            persisted.store(last->sequence);
+            persistedObjectVersion.store(last->version);
+            requestedSequence = completed = last->sequence;
+        }
+
+        worker = std::thread([this]() { run(); });
+    }
+
+    //waits for a running snapshot
+    ~SnapshotFile()
+    {
+        {
+            std::lock_guard<std::mutex> g(mutex);
+            stopped = true;
+        }
+        requested.notify_one();
+        worker.join();
+        munmap(data, mappingSize);
+        close(fd);
+    }
+
+    SnapshotFile(const SnapshotFile &) = delete;
+    SnapshotFile(SnapshotFile &&) = delete;
+
+    //start a snapshot of the current version in the background (joined with a snapshot which was requested but not started)
+    //returns the ticket to wait for it
+    uint64_t snapshot()
+    {
+        std::lock_guard<std::mutex> g(mutex);
+        if (!pending)
+        {
+            pending = true;
+            ++requestedSequence;
+        }
+        requested.notify_one();
+        return requestedSequence;
+    }
+
+    //ticket of the last durable snapshot (0 if there is none), tickets continue after the snapshots of a previous run
+    uint64_t persistedSequence() const
+    {
+        return persisted.load(std::memory_order_acquire);
+    }
+
+    //object version of the last durable snapshot (empty if there is none)
+    std::optional<uint64_t> persistedVersion() const
+    {
+        if (persisted.load(std::memory_order_acquire) == 0)
+        {
+            return std::nullopt;
+        }
+        return persistedObjectVersion.load(std::memory_order_acquire);
+    }
+
+    //wait until the snapshot with the ticket is written, returns false if it failed
+    //(or if the ticket was not returned by snapshot, which would never be written)
+    bool wait(uint64_t ticket)
+    {
+        std::unique_lock<std::mutex> g(mutex);
+        assert(ticket <= requestedSequence && "wait for a snapshot which was not requested");
+        if (ticket > requestedSequence)
+        {
+            return false;
+        }
+        done.wait(g, [&]() { return completed >= ticket; });
+        return persisted.load() >= ticket;
+    }
+
+    //errno of the last failed snapshot (0 if none failed)
+    int lastError() const
+    {
+        return error;
+    }
+
+    //calls deserializer(buffer, size) with the last durable snapshot in path (directly from the mapping),
+    //returns the object version it was taken at (empty if there is none, then the deserializer is not called)
+    template <typename Deserializer>
+    static std::optional<uint64_t> load(const std::string &path, Deserializer &&deserializer)
+    {
+        auto fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return std::nullopt;
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0)
+        {
+            close(fd);
+            return std::nullopt;
+        }
+        size_t size = status.st_size;
+        auto address = size >= HEADER_SIZE ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (address == MAP_FAILED)
+        {
+            return std::nullopt;
+        }
+
+        std::optional<uint64_t> version;
+        auto data = static_cast<char *>(address);
+        auto header = reinterpret_cast<const Header *>(data);
+        if (header->magic == MAGIC)
+        {
+            if (auto last = latest(data, size))
+            {
+                deserializer(static_cast<const char *>(data + last->offset), size_t(last->size));
+                version = last->version;
+            }
+        }
+        munmap(address, size);
+        return version;
+    }
+
+private:
+    static constexpr uint64_t MAGIC{0x756c66736e617033}; //"ulfsnap3"
+    static constexpr size_t HEADER_SIZE{4096};
+    static constexpr size_t ALIGNMENT{4096};
+
+    struct Record
+    {
+        uint64_t sequence{0}; //0 if unused
+        uint64_t version{0};
+        uint64_t offset{0};
+        uint64_t size{0};
+        uint64_t checksum{0};
+    };
+
+    struct Header
+    {
+        uint64_t magic{MAGIC};
+        Record records[2]; //the last two snapshots
+    };
+
+    LockFree<T, Alloc, Policy> &object;
+    Serializer serializer;
+
+    int fd;
+    char *data{nullptr};
+    size_t mappingSize{0};
+    int lastRecord{-1}; //record of the last durable snapshot (only used by the worker after construction)
+
+    std::atomic<uint64_t> persisted{0}; //sequence of the last durable snapshot
+    std::atomic<uint64_t> persistedObjectVersion{0};
+    std::atomic<int> error{0};
+
+    std::mutex mutex;
+    std::condition_variable requested;
+    std::condition_variable done;
+    uint64_t requestedSequence{0};
+    uint64_t completed{0}; //sequence of the last snapshot written or failed
+    bool pending{false};
+    bool stopped{false};
+    std::thread worker;
+
+    Header *header()
+    {
+        return reinterpret_cast<Header *>(data);
+    }
+
+    static uint64_t checksum(const char *buffer, size_t size, uint64_t hash = 0xcbf29ce484222325)
+    {
+        //FNV-1a
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ uint8_t(buffer[i])) * 0x100000001b3;
+        }
+        return hash;
+    }
+
+    //of the record fields and the snapshot data (the record must be inside the file)
+    static uint64_t checksum(const Record &record, const char *data)
+    {
+        uint64_t fields[]{record.sequence, record.version, record.offset, record.size};
+        auto hash = checksum(reinterpret_cast<const char *>(fields), sizeof(fields));
+        return checksum(data + record.offset, record.size, hash);
+    }
+
+    //the valid record with the highest sequence number, nullptr if there is none
+    static const Record *latest(const char *data, size_t size)
+    {
+        auto header = reinterpret_cast<const Header *>(data);
+        const Record *last = nullptr;
+        for (auto &record : header->records)
+        {
+            if (record.sequence != 0 && record.offset >= HEADER_SIZE && record.size <= size && record.offset <= size - record.size &&
+                checksum(record, data) == record.checksum &&
+                (!last || record.sequence > last->sequence))
+            {
+                last = &record;
+            }
+        }
+        return last;
+    }
+
+    //the file has at least size bytes afterwards (and the mapping covers it)
+    bool remap(size_t size)
+    {
+        struct stat status;
+        if (fstat(fd, &status) != 0)
+        {
+            return false;
+        }
+        if (size_t(status.st_size) < size && ftruncate(fd, size) != 0)
+        {
+            return false;
+        }
+        size = std::max(size, size_t(status.st_size));
+        auto address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            return false;
+        }
+        if (data)
+        {
+            munmap(data, mappingSize);
+        }
+        data = static_cast<char *>(address);
+        mappingSize = size;
+        return true;
+    }
+
+    static size_t align(size_t offset)
+    {
+        return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> g(mutex);
+        while (true)
+        {
+            requested.wait(g, [&]() { return pending || stopped; });
+            if (!pending)
+            {
+                return;
+            }
+            pending = false;
+            auto sequence = requestedSequence;
+
+            g.unlock();
+            uint64_t version = 0;
+            auto result = write(sequence, version);
+            g.lock();
+
+            if (result == 0)
+            {
+                persistedObjectVersion.store(version, std::memory_order_relaxed);
+                persisted.store(sequence, std::memory_order_release);
+            }
+            completed = sequence;
+            error = result;
+            done.notify_all();
+        }
+    }
+
+    //returns 0 or errno
+    int write(uint64_t sequence, uint64_t &version)
+    {
+        //next to the last snapshot (in front of it if there is enough space)
+        Record last = lastRecord < 0 ? Record() : header()->records[lastRecord];
+        size_t lastEnd = align(last.offset + last.size);
+        size_t offset = HEADER_SIZE;
+        size_t limit = last.offset > HEADER_SIZE ? last.offset : mappingSize;
+        if (last.offset == HEADER_SIZE)
+        {
+            offset = lastEnd;
+        }
+
+        //counted updates are published before, hence the protected version contains at least them
+        version = object.version();
+        auto current = ::snapshot(object); //protected until the snapshot is serialized
+        auto &value = current.template get<0>();
+        auto capacity = limit > offset ? limit - offset : 0;
+        auto size = serializer(value, data + offset, capacity);
+        if (size > capacity)
+        {
+            //does not fit in front of the last snapshot, try again behind it (growing the file)
+            offset = std::max(offset, lastEnd);
+            if (!remap(offset + size))
+            {
+                return errno;
+            }
+            size = serializer(value, data + offset, size);
+        }
+
+        if (msync(data + offset, size, MS_SYNC) != 0 || fdatasync(fd) != 0)
+        {
+            return errno;
+        }
+
+        //the snapshot becomes the last one with its record (the other one than the record of the last snapshot,
+        //a record which is torn by a crash is invalid because its checksum covers all its fields)
+        auto index = lastRecord == 0 ? 1 : 0;
+        auto &record = header()->records[index];
+        record.sequence = sequence;
+        record.version = version;
+        record.offset = offset;
+        record.size = size;
+        record.checksum = checksum(record, data);
+        if (msync(data, HEADER_SIZE, MS_SYNC) != 0)
+        {
+            return errno;
+        }
+        lastRecord = index;
+        return 0;
+    }
+};
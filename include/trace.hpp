@@ -0,0 +1,250 @@
+#pragma once
+
+//probes at internal events (hazard pointers, CAS in invoke, scans, deallocation) to correlate latency spikes with them
+//they compile to nothing unless LOCKFREE_TRACE is defined (cmake -DLOCKFREE_TRACE=ON)
+//
+//if <sys/sdt.h> is available every probe is also a USDT probe of provider universal_lockfree, e.g.
+//  bpftrace -p PID -e 'usdt:./universal_lockfree:universal_lockfree:SCAN_END { @deleted = hist(arg1); }'
+//in any case the last events of every thread are kept in a ring buffer, which can be dumped (e.g. from a debugger)
+//
+//every event has two integer arguments:
+//  ACQUIRE     domain, hazard pointer
+//  CREATE      domain, hazard pointer id
+//  CAS_SUCCESS object, attempt (starting at 1)
+//  CAS_FAILURE object, attempt
+//  SCAN_START  domain, number of hazard pointers
+//  SCAN_END    number of candidates, number deleted
+//  COMPACT     domain, number of unlinked hazard pointers
+//  DEALLOCATE  object, deallocated pointer
+//  THROTTLE    object, number of unreclaimed versions
+
+#ifdef LOCKFREE_TRACE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define LOCKFREE_USDT
+#endif
+#endif
+
+enum class TraceEvent : uint32_t
+{
+    ACQUIRE,
+    CREATE,
+    CAS_SUCCESS,
+    CAS_FAILURE,
+    SCAN_START,
+    SCAN_END,
+    COMPACT,
+    DEALLOCATE,
+    THROTTLE
+};
+
+class TraceBuffer
+{
+public:
+    static constexpr size_t CAPACITY{1024}; //events per thread
+
+    static void record(TraceEvent event, uint64_t a, uint64_t b)
+    {
+        auto buffer = local();
+        if (!buffer)
+        {
+            return; //the thread is exiting and returned its buffer
+        }
+        auto index = buffer->numRecords.load(std::memory_order_relaxed);
+        auto &record = buffer->records[index % CAPACITY];
+        //like a seqlock with the event number as sequence: invalid while the fields are written
+        record.sequence.store(INVALID, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        record.timestamp.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count(),
+                               std::memory_order_relaxed);
+        record.event.store(event, std::memory_order_relaxed);
+        record.a.store(a, std::memory_order_relaxed);
+        record.b.store(b, std::memory_order_relaxed);
+        record.sequence.store(index, std::memory_order_release);
+        buffer->numRecords.store(index + 1, std::memory_order_release);
+    }
+
+    //the last events of all threads (up to last per thread), also while the threads record
+    //(events overwritten during the dump are skipped)
+    static void dump(std::ostream &out = std::cout, size_t last = CAPACITY)
+    {
+        std::lock_guard<std::mutex> g(registryMutex());
+        for (auto &buffer : registry())
+        {
+            auto numRecords = buffer->numRecords.load(std::memory_order_acquire);
+            auto count = std::min<uint64_t>(std::min<uint64_t>(numRecords, CAPACITY), last);
+            out << "thread " << buffer->thread << (buffer->exited ? " (exited)" : "") << " events " << numRecords << std::endl;
+            for (auto index = numRecords - count; index < numRecords; ++index)
+            {
+                auto &record = buffer->records[index % CAPACITY];
+                if (record.sequence.load(std::memory_order_acquire) != index)
+                {
+                    continue;
+                }
+                auto timestamp = record.timestamp.load(std::memory_order_relaxed);
+                auto event = record.event.load(std::memory_order_relaxed);
+                auto a = record.a.load(std::memory_order_relaxed);
+                auto b = record.b.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (record.sequence.load(std::memory_order_relaxed) != index)
+                {
+                    continue;
+                }
+                out << timestamp << " " << name(event) << " " << a << " " << b << std::endl;
+            }
+        }
+    }
+
+    static const char *name(TraceEvent event)
+    {
+        switch (event)
+        {
+        case TraceEvent::ACQUIRE:
+            return "ACQUIRE";
+        case TraceEvent::CREATE:
+            return "CREATE";
+        case TraceEvent::CAS_SUCCESS:
+            return "CAS_SUCCESS";
+        case TraceEvent::CAS_FAILURE:
+            return "CAS_FAILURE";
+        case TraceEvent::SCAN_START:
+            return "SCAN_START";
+        case TraceEvent::SCAN_END:
+            return "SCAN_END";
+        case TraceEvent::COMPACT:
+            return "COMPACT";
+        case TraceEvent::DEALLOCATE:
+            return "DEALLOCATE";
+        case TraceEvent::THROTTLE:
+            return "THROTTLE";
+        }
+        return "";
+    }
+
+    template <typename V>
+    static uint64_t value(V v)
+    {
+        if constexpr (std::is_pointer<V>::value)
+        {
+            return reinterpret_cast<uintptr_t>(v);
+        }
+        else
+        {
+            return static_cast<uint64_t>(v);
+        }
+    }
+
+private:
+    static constexpr uint64_t INVALID{~0ull};
+
+    //written by its thread while dump may read it, hence atomic (relaxed, the sequence orders them)
+    struct Record
+    {
+        std::atomic<uint64_t> sequence{INVALID}; //number of the event in the thread
+        std::atomic<uint64_t> timestamp{0};
+        std::atomic<TraceEvent> event{TraceEvent::ACQUIRE};
+        std::atomic<uint64_t> a{0};
+        std::atomic<uint64_t> b{0};
+    };
+
+    std::thread::id thread{std::this_thread::get_id()};
+    bool exited{false}; //under the registry mutex
+    std::atomic<uint64_t> numRecords{0};
+    Record records[CAPACITY];
+
+    //returns the buffer of the thread when it exits
+    struct Owner
+    {
+        ~Owner()
+        {
+            std::lock_guard<std::mutex> g(registryMutex());
+            t_buffer->exited = true;
+            t_buffer = nullptr;
+            t_exited = true;
+        }
+    };
+
+    static inline thread_local TraceBuffer *t_buffer{nullptr};
+    static inline thread_local bool t_exited{false}; //events of later thread_local destructors are dropped
+
+    //buffers are kept after their thread exited, to see what it did last, until a new thread reuses them
+    //(hence there are at most as many as threads were running at the same time)
+    static std::vector<std::shared_ptr<TraceBuffer>> &registry()
+    {
+        static std::vector<std::shared_ptr<TraceBuffer>> s_registry;
+        return s_registry;
+    }
+
+    static std::mutex &registryMutex()
+    {
+        static std::mutex s_mutex;
+        return s_mutex;
+    }
+
+    static TraceBuffer *local()
+    {
+        if (!t_buffer && !t_exited)
+        {
+            thread_local Owner t_owner;
+            t_buffer = claim();
+        }
+        return t_buffer;
+    }
+
+    static TraceBuffer *claim()
+    {
+        std::lock_guard<std::mutex> g(registryMutex());
+        for (auto &buffer : registry())
+        {
+            if (buffer->exited)
+            {
+                buffer->thread = std::this_thread::get_id();
+                buffer->exited = false;
+                buffer->numRecords.store(0, std::memory_order_relaxed);
+                return buffer.get();
+            }
+        }
+        registry().push_back(std::make_shared<TraceBuffer>());
+        return registry().back().get();
+    }
+};
+
+#ifdef LOCKFREE_USDT
+#define LOCKFREE_PROBE(EVENT, a, b)                                                                 \
+    do                                                                                              \
+    {                                                                                               \
+        auto lockfreeProbeA = TraceBuffer::value(a);                                                \
+        auto lockfreeProbeB = TraceBuffer::value(b);                                                \
+        DTRACE_PROBE2(universal_lockfree, EVENT, lockfreeProbeA, lockfreeProbeB);                   \
+        TraceBuffer::record(TraceEvent::EVENT, lockfreeProbeA, lockfreeProbeB);                     \
+    } while (0)
+#else
+#define LOCKFREE_PROBE(EVENT, a, b) TraceBuffer::record(TraceEvent::EVENT, TraceBuffer::value(a), TraceBuffer::value(b))
+#endif
+
+#else
+
+//the arguments are not evaluated
+#define LOCKFREE_PROBE(EVENT, a, b) \
+    do                              \
+    {                               \
+        (void)sizeof(a);            \
+        (void)sizeof(b);            \
+    } while (0)
+
+#endif
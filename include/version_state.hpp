@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//the state of a version in a fixed array of versions (FixedLockFree, SharedLockFree), in one word:
+//  bits 0-1   kind (FREE, WRITING, PUBLISHED, RETIRED)
+//  bits 2-31  how often the version was allocated
+//  bits 32-63 owner while WRITING (e.g. the pid of the writing process, 0 if not needed)
+//
+//a version is allocated (FREE -> WRITING), published after it became current (WRITING -> PUBLISHED), retired by
+//the writer which replaced it (-> RETIRED, possibly before it was marked published) and claimed by a reclaimer
+//(RETIRED -> WRITING -> FREE)
+//
+//every transition compares the whole word, hence it only applies to the life of the version it was observed in
+//(a reclaimer may only claim the version it saw retired, not the same version retired again later)
+
+class VersionState
+{
+public:
+    enum Kind : uint64_t
+    {
+        FREE,
+        WRITING,
+        PUBLISHED, //current or replaced but not retired yet
+        RETIRED,
+        KIND = 3
+    };
+
+    static constexpr Kind kind(uint64_t state)
+    {
+        return Kind(state & KIND);
+    }
+
+    static constexpr uint32_t owner(uint64_t state)
+    {
+        return uint32_t(state >> 32);
+    }
+
+    static constexpr uint64_t with(uint64_t state, Kind kind, uint32_t owner = 0)
+    {
+        return uint64_t(owner) << 32 | (state & GENERATION_MASK) | kind;
+    }
+
+    //returns the WRITING state of the new life, 0 if the version is not free
+    static uint64_t tryAllocate(std::atomic<uint64_t> &state, uint32_t owner = 0)
+    {
+        auto expected = state.load(std::memory_order_relaxed);
+        if (kind(expected) != FREE)
+        {
+            return 0;
+        }
+        auto writing = with(expected + GENERATION, WRITING, owner);
+        return state.compare_exchange_strong(expected, writing) ? writing : 0;
+    }
+
+    //after the version became current, nothing if it was already retired
+    static void publish(std::atomic<uint64_t> &state, uint64_t writing)
+    {
+        state.compare_exchange_strong(writing, with(writing, PUBLISHED));
+    }
+
+    //only by the writer which replaced the version (it still protects it, hence it is still in the same life)
+    static void retire(std::atomic<uint64_t> &state)
+    {
+        state.fetch_or(RETIRED, std::memory_order_release);
+    }
+
+    //the version never became current
+    static void abandon(std::atomic<uint64_t> &state, uint64_t writing)
+    {
+        state.store(with(writing, FREE), std::memory_order_release);
+    }
+
+    //only if the version did not change since it was observed
+    static bool tryChange(std::atomic<uint64_t> &state, uint64_t observed, Kind kind, uint32_t owner = 0)
+    {
+        return state.compare_exchange_strong(observed, with(observed, kind, owner));
+    }
+
+    //exclusive access to a version observed as retired, returns the WRITING state (0 if it changed since)
+    static uint64_t tryClaim(std::atomic<uint64_t> &state, uint64_t observed, uint32_t owner = 0)
+    {
+        return tryChange(state, observed, WRITING, owner) ? with(observed, WRITING, owner) : 0;
+    }
+
+    static void release(std::atomic<uint64_t> &state, uint64_t claimed)
+    {
+        abandon(state, claimed);
+    }
+
+private:
+    static constexpr uint64_t GENERATION{KIND + 1};
+    static constexpr uint64_t GENERATION_MASK{0xffffffff & ~uint64_t(KIND)};
+};
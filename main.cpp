@@ -1,7 +1,31 @@
 #include <iostream>
+#include <atomic>
 #include <chrono>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <deque>
+#include <array>
+#include <functional>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "lockfree_wrapper.hpp"
+#include "sharded_lockfree.hpp"
+#include "lazy_lockfree.hpp"
+#include "lockfree_cells.hpp"
+#include "lockfree_map.hpp"
+#include "persistent_map.hpp"
+#include "persistent_vector.hpp"
+#include "huge_page_arena.hpp"
+#include "shared_lockfree.hpp"
+#include "snapshot_file.hpp"
+#include "async_invoke.hpp"
+#include "adaptive_lockfree.hpp"
+#include "policy_benchmark.hpp"
+#include "fixed_lockfree.hpp"
 #include "foo.hpp"
 #include "allocator.hpp"
 
@@ -64,6 +88,334 @@ int main(int argc, char **argv)
         std::cout << "read value " << value << std::endl;
     }
 
+    {
+        //move value from one object to another, readers see either both old or both new values
+        LockFree<Foo> from(73);
+        LockFree<Foo> to(0);
+
+        auto result = multiInvoke([](Foo *a, Foo *b) { b->inc(a->read()); a->write(0); return b->read(); }, from, to);
+        std::cout << "result " << result << std::endl;
+        std::cout << "read values " << from.readOnly()->read() << " " << to.readOnly()->read() << std::endl;
+    }
+
+    {
+        struct Add
+        {
+            void operator()(Foo &result, const Foo &shard)
+            {
+                result.inc(shard.read());
+            }
+        };
+
+        ShardedLockFree<Foo, Add> counter(4);
+        counter.invoke(&Foo::inc, 37);
+        std::thread([&]() { counter.invoke(&Foo::inc, 5); }).join();
+
+        std::cout << "read value " << counter.read().read() << std::endl;
+        std::cout << "read value " << counter.read().read() << std::endl; //cached
+    }
+
+    {
+        LazyLockFree<Foo> lazy(16, 73);
+        lazy.invoke(&Foo::inc, 1); //only appended to the log
+        lazy.invoke(&Foo::write, 42);
+        lazy.invoke(&Foo::inc, 3);
+
+        std::cout << "read value " << lazy.readOnly()->read() << std::endl; //one copy for all three updates
+    }
+
+    {
+        //a hot object with its own arena and two objects sharing a memory resource
+        LockFree<Foo, ArenaAllocator> hot(std::allocator_arg, ArenaAllocator(ArenaAllocator::DEFAULT_RESERVED_SIZE), 42);
+        hot.invoke(&Foo::inc, 31);
+        std::cout << "read value " << hot.readOnly()->read() << std::endl;
+        hot.getAllocator().print();
+
+        std::pmr::synchronized_pool_resource pool;
+        LockFree<Foo, PmrAllocator> a(std::allocator_arg, PmrAllocator(&pool), 1);
+        multiInvoke([](Foo *a, Foo *b) { a->inc(b->read()); return true; }, a, hot);
+        std::cout << "read value " << a.readOnly()->read() << std::endl;
+
+        //single byte versions from a monotonic buffer, still aligned such that multi updates can tag them
+        std::pmr::monotonic_buffer_resource buffer;
+        LockFree<char, PmrAllocator> letter(std::allocator_arg, PmrAllocator(&buffer), 'a');
+        LockFree<char, PmrAllocator> other(std::allocator_arg, PmrAllocator(&buffer), 'x');
+        for (int i = 0; i < 3; ++i)
+        {
+            multiInvoke([](char *a, char *b) { ++*a; ++*b; return true; }, letter, other);
+        }
+        std::cout << "read letters " << *letter.readOnly() << *other.readOnly() << std::endl;
+    }
+
+    {
+        //versions and hazard pointers in huge pages (explicit if reserved, transparent otherwise)
+        HugePageResource pages(HugePageResource::HUGE_PAGE_SIZE);
+        HazardDomain domain(&pages);
+        LockFree<Foo, HugePageAllocator> big(std::allocator_arg, HugePageAllocator(), domain, 7);
+        for (int i = 0; i < 100; ++i)
+        {
+            big.invoke(&Foo::inc, 1);
+        }
+        std::cout << "read value " << big.readOnly()->read() << std::endl;
+        big.getAllocator().print();
+        pages.print();
+    }
+
+    {
+        //many small objects share the hazard pointers of one domain
+        HazardDomain domain;
+        std::vector<std::unique_ptr<LockFree<Foo>>> table;
+        for (int i = 0; i < 1000; ++i)
+        {
+            table.emplace_back(new LockFree<Foo>(domain, i));
+        }
+
+        std::thread([&]() { for (auto &entry : table) { entry->invoke(&Foo::inc, 1); } }).join();
+        for (auto &entry : table)
+        {
+            entry->invoke(&Foo::inc, 1);
+        }
+
+        std::cout << "read value " << table[42]->readOnly()->read() << std::endl;
+        std::cout << "domain #hazard pointers " << domain.numHazardPointers() << std::endl;
+    }
+
+    {
+        //a cell is only one pointer, all cells share the hazard domain and allocator
+        LockFreeArray<Foo, 64> array(Foo(0));
+        array.invoke(7, &Foo::inc, 42);
+        std::cout << "read value " << array.readOnly(7)->read() << std::endl;
+
+        LockFreeMap<int, Foo> map(64);
+        map.insert(1, Foo(73));
+        map.invoke(2, &Foo::inc, 42); //default constructed before
+        map.erase(1);
+        std::cout << "found " << bool(map.find(1)) << " read value " << map.find(2)->read() << std::endl;
+    }
+
+    {
+        //large containers, an update copies O(log n) nodes instead of the whole container
+        LockFree<PersistentMap<int, int>> routes;
+        LockFree<PersistentVector<int>> log;
+        for (int i = 0; i < 10000; ++i)
+        {
+            routes.invoke([&](PersistentMap<int, int> *map) { map->set(i, i % 16); return true; });
+            log.invoke([&](PersistentVector<int> *vector) { vector->push_back(i); return true; });
+        }
+
+        auto reader = routes.readOnly(); //this version is unchanged by later updates
+        routes.invoke([](PersistentMap<int, int> *map) { return map->erase(42); });
+        std::cout << "read value " << *reader->find(42) << " size " << reader->size() << " " << routes.readOnly()->size() << std::endl;
+        std::cout << "read value " << (*log.readOnly())[9999] << std::endl;
+    }
+
+    {
+        //an object in shared memory updated by two processes
+        SharedLockFree<Foo>::unlink("/universal_lockfree_demo");
+        SharedLockFree<Foo> shared("/universal_lockfree_demo", 0);
+        auto child = fork();
+        if (child == 0)
+        {
+            SharedLockFree<Foo> attached("/universal_lockfree_demo");
+            for (int i = 0; i < 1000; ++i)
+            {
+                attached.invoke(&Foo::inc, 1);
+            }
+            _exit(0);
+        }
+        for (int i = 0; i < 1000; ++i)
+        {
+            shared.invoke(&Foo::inc, 1);
+        }
+        waitpid(child, nullptr, 0);
+        std::cout << "read value " << shared.readOnly()->read() << std::endl;
+        SharedLockFree<Foo>::unlink("/universal_lockfree_demo");
+    }
+
+    {
+        //durable snapshots written in the background while the object is updated
+        LockFree<Foo> config(1);
+        {
+            SnapshotFile<Foo> file(config, "/tmp/universal_lockfree.snapshot", [](const Foo &foo, char *buffer, size_t capacity) {
+                if (capacity >= sizeof(int))
+                {
+                    std::memcpy(buffer, &foo.value, sizeof(int));
+                }
+                return sizeof(int);
+            });
+            config.invoke(&Foo::inc, 41);
+            file.wait(file.snapshot());
+            config.invoke(&Foo::inc, 1); //not in the snapshot
+            std::cout << "persisted version " << file.persistedVersion().value_or(0) << " current " << config.version() << std::endl;
+        }
+
+        //restart from the last snapshot
+        int value = 0;
+        auto version = SnapshotFile<Foo>::load("/tmp/universal_lockfree.snapshot",
+                                               [&](const char *buffer, size_t) { std::memcpy(&value, buffer, sizeof(int)); });
+        LockFree<Foo> restored(value);
+        std::cout << "read value " << restored.readOnly()->read() << " snapshot version " << version.value_or(0) << std::endl;
+        unlink("/tmp/universal_lockfree.snapshot");
+    }
+
+    {
+        //a reader which keeps its hazard pointer, reads of an unchanged object are a single load
+        LockFree<Foo> config(3);
+        auto reader = config.reader();
+        int sum = 0;
+        for (int i = 0; i < 1000; ++i)
+        {
+            sum += reader->read();
+        }
+        config.invoke(&Foo::inc, 1);
+        std::cout << "read value " << sum << " " << reader->read() << std::endl;
+    }
+
+    {
+        //versions of two objects which were current at the same time
+        LockFree<Foo> index(1);
+        LockFree<Foo> data(2);
+        multiInvoke([](Foo *index, Foo *data) { index->inc(1); data->inc(1); return true; }, index, data);
+        auto [i, d] = snapshot(index, data);
+        std::cout << "read values " << i.read() << " " << d.read() << std::endl;
+    }
+
+    {
+        //concurrent transfers between two accounts, every snapshot has to see the same total
+        LockFree<Foo> left(1000);
+        LockFree<Foo> right(1000);
+        std::atomic<bool> done{false};
+        std::atomic<uint64_t> violations{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&, t]() {
+                int amount = t % 2 == 0 ? 1 : -1;
+                for (int i = 0; i < 10000; ++i)
+                {
+                    multiInvoke([&](Foo *a, Foo *b) { a->inc(-amount); b->inc(amount); return true; }, left, right);
+                }
+            });
+        }
+        for (int t = 0; t < 2; ++t)
+        {
+            threads.emplace_back([&]() {
+                while (!done.load())
+                {
+                    auto [l, r] = snapshot(left, right);
+                    if (l.read() + r.read() != 2000)
+                    {
+                        violations.fetch_add(1);
+                    }
+                }
+            });
+        }
+        for (int t = 0; t < 4; ++t)
+        {
+            threads[t].join();
+        }
+        done.store(true);
+        for (int t = 4; t < 6; ++t)
+        {
+            threads[t].join();
+        }
+        std::cout << "transfers conserved total " << left.readOnly()->read() + right.readOnly()->read() << " violations "
+                  << violations.load() << std::endl;
+        if (violations.load() != 0)
+        {
+            return 1;
+        }
+    }
+
+    {
+        //a derived value which is updated with the difference of each update instead of reading the whole object again
+        //(the hooks of concurrent writers run concurrently and out of order, adding differences does not depend on the order)
+        LockFree<Foo> counter(0);
+        std::atomic<int64_t> total{0};
+        counter.onCommit([&](const Foo *oldVersion, const Foo *newVersion) { total.fetch_add(newVersion->read() - oldVersion->read()); });
+        std::vector<std::thread> writers;
+        for (int i = 0; i < 4; ++i)
+        {
+            writers.emplace_back([&]() {
+                for (int j = 0; j < 1000; ++j)
+                {
+                    counter.invoke(&Foo::inc, j % 2 == 0 ? 5 : -3);
+                }
+            });
+        }
+        for (auto &writer : writers)
+        {
+            writer.join();
+        }
+        std::cout << "read value " << counter.readOnly()->read() << " derived " << total.load() << std::endl;
+    }
+
+    {
+        //readers which keep old versions alive throttle the writers instead of letting old versions pile up
+        LockFree<Foo> counter(0);
+        counter.setMaxUnreclaimed(2);
+        auto first = counter.reader();
+        counter.invoke(&Foo::inc, 1);
+        auto second = counter.reader();
+        counter.invoke(&Foo::inc, 1);
+        bool updated = counter.tryInvoke(&Foo::inc, 1).has_value(); //both replaced versions are still read
+        std::cout << "unreclaimed " << counter.unreclaimed() << " updated " << updated << std::endl;
+    }
+
+    {
+        //updates scheduled on a task queue, a contended update is queued again instead of retrying
+        std::deque<std::function<void()>> tasks;
+        auto executor = [&](std::function<void()> task) { tasks.push_back(std::move(task)); };
+
+        LockFree<Foo> counter(0);
+        waitForUpdateAsync(counter, counter.version(), executor, [](uint64_t version) { std::cout << "updated to version " << version << std::endl; });
+        invokeAsync(counter, executor, [](Foo *foo) { return foo->inc(5); }, [](int value) { std::cout << "read value " << value << std::endl; });
+        while (!tasks.empty())
+        {
+            auto task = std::move(tasks.front());
+            tasks.pop_front();
+            task();
+        }
+    }
+
+    {
+        //a large object, writers combine their updates if copies are lost to conflicts too often
+        AdaptiveLockFree<std::array<int, 16384>> table;
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t)
+        {
+            writers.emplace_back([&]() { for (int i = 0; i < 1000; ++i) { table.invoke([](std::array<int, 16384> *a) { return ++(*a)[0]; }); } });
+        }
+        for (auto &writer : writers)
+        {
+            writer.join();
+        }
+        std::cout << "read value " << (*table.readOnly())[0] << " mode " << (table.getMode() == AdaptiveLockFree<std::array<int, 16384>>::COPY ? "copy" : "combine") << std::endl;
+    }
+
+    {
+        //no allocation after construction, at most 4 threads use the object at the same time
+        FixedLockFree<Foo, 4> fixed(0);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t)
+        {
+            writers.emplace_back([&]() { for (int i = 0; i < 1000; ++i) { fixed.invoke(&Foo::inc, 1); } });
+        }
+        for (auto &writer : writers)
+        {
+            writer.join();
+        }
+        std::cout << "read value " << fixed.readOnly()->read() << " versions " << fixed.capacity() << std::endl;
+    }
+
+    //every reclamation, recycling and proxy strategy side by side
+    benchmarkPolicies<Foo>([](auto &object) { object.invoke(&Foo::inc, 1); }, [](auto &object) { return object.readOnly()->read(); },
+                           10000, 2, 2);
+
+#ifdef LOCKFREE_TRACE
+    TraceBuffer::dump(std::cout, 8); //last events of each thread
+#endif
+
     //check if there are undeleted objects
     Allocator::print();
 #endif
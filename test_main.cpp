@@ -1,10 +1,48 @@
 #include <iostream>
+#include <atomic>
 #include <thread>
 #include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
 
-#include "minimal_lockfree_wrapper.hpp"
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "lockfree_wrapper.hpp"
 #include "allocator.hpp"
 #include "bar.hpp"
+#include "latency_histogram.hpp"
+#include "policy_benchmark.hpp"
+#include "async_invoke.hpp"
+#include "snapshot_file.hpp"
+#include "lockfree_map.hpp"
+#include "sharded_lockfree.hpp"
+#include "lazy_lockfree.hpp"
+#include "persistent_map.hpp"
+#include "persistent_vector.hpp"
+#include "shared_lockfree.hpp"
+#include "adaptive_lockfree.hpp"
+#include "fixed_lockfree.hpp"
+#include "huge_page_arena.hpp"
+#include "foo.hpp"
+
+//checks of the expected behavior, main fails if any of them failed
+int g_failures = 0;
+
+void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        std::cout << "FAILED " << what << std::endl;
+        ++g_failures;
+    }
+}
 
 template <typename TestObject>
 void work(TestObject &object, int a = 1, int iterations = 1000000)
@@ -68,8 +106,1114 @@ void testLockfree(TestObject &object, int iterations = 1000000, int n = 2, int m
     }
 }
 
+//latencies of one thread, merged after all threads are joined
+struct Latencies
+{
+    LatencyHistogram invoke;
+    LatencyHistogram acquire; //readOnly() until the proxy can be used
+    LatencyHistogram release; //destruction of the proxy
+    LatencyHistogram scan;    //reclamation scans (recorded by the thread which scans)
+
+    void merge(const Latencies &other)
+    {
+        invoke.merge(other.invoke);
+        acquire.merge(other.acquire);
+        release.merge(other.release);
+        scan.merge(other.scan);
+    }
+
+    void print()
+    {
+        invoke.print("invoke");
+        acquire.print("readOnly acquire");
+        release.print("readOnly release");
+        scan.print("scan");
+    }
+};
+
+thread_local Latencies *t_latencies{nullptr};
+
+void recordScan(std::chrono::nanoseconds duration)
+{
+    if (t_latencies)
+    {
+        t_latencies->scan.record(duration);
+    }
+}
+
+template <typename TestObject>
+void workLatency(TestObject &object, Latencies &latencies, int writePercent, int iterations)
+{
+    using Clock = LatencyHistogram::Clock;
+    t_latencies = &latencies;
+    int sink = 0;
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        if (i % 100 < writePercent)
+        {
+            auto start = Clock::now();
+            object.invoke(&Bar::work, 1);
+            latencies.invoke.record(Clock::now() - start);
+        }
+        else
+        {
+            auto start = Clock::now();
+            Clock::time_point released;
+            {
+                auto reader = object.readOnly();
+                auto acquired = Clock::now();
+                sink += reader->a.load(std::memory_order_relaxed);
+                latencies.acquire.record(acquired - start);
+                released = Clock::now();
+            }
+            latencies.release.record(Clock::now() - released);
+        }
+    }
+
+    t_latencies = nullptr;
+    if (sink == 42)
+    {
+        std::cout << std::endl; //keeps the reads
+    }
+}
+
+//tail latencies of all threads for every number of threads and read/write mix
+//(with scanWork > 0 the scans are incremental, i.e. spread over the retires in steps of at most scanWork)
+void testLatency(int iterations = 100000, uint32_t scanWork = 0)
+{
+    HazardDomain::global().observeScans(&recordScan);
+    HazardDomain::global().setIncrementalScan(scanWork);
+
+    for (int numThreads : {1, 2, 4, 8})
+    {
+        for (int writePercent : {0, 10, 50, 100})
+        {
+            LockFree<Bar> object;
+            std::vector<Latencies> latencies(numThreads);
+            std::vector<std::thread> threads;
+            threads.reserve(numThreads);
+
+            for (int i = 0; i < numThreads; ++i)
+            {
+                threads.emplace_back(workLatency<LockFree<Bar>>, std::ref(object), std::ref(latencies[i]), writePercent, iterations);
+            }
+
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+
+            Latencies merged;
+            for (auto &l : latencies)
+            {
+                merged.merge(l);
+            }
+
+            std::cout << "latency (ns) threads " << numThreads << " writes " << writePercent << "% scan work " << scanWork << std::endl;
+            merged.print();
+        }
+    }
+
+    HazardDomain::global().setIncrementalScan(0);
+    HazardDomain::global().observeScans(nullptr);
+}
+
+//average time of a read with a new proxy each time and with a reader handle (while a writer updates seldom)
+void testReaderHandle(int iterations = 10000000)
+{
+    LockFree<Bar> object;
+    std::atomic_bool done{false};
+    std::thread writer([&]() {
+        while (!done.load())
+        {
+            object.invoke(&Bar::work, 1);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    int sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        sink += object.readOnly()->a.load(std::memory_order_relaxed);
+    }
+    auto proxyTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    {
+        auto reader = object.reader();
+        for (int i = 0; i < iterations; ++i)
+        {
+            sink += reader->a.load(std::memory_order_relaxed);
+        }
+    }
+    auto handleTime = std::chrono::steady_clock::now() - start;
+
+    done.store(true);
+    writer.join();
+    std::cout << "read (ns) proxy " << std::chrono::duration<double, std::nano>(proxyTime).count() / iterations << " handle "
+              << std::chrono::duration<double, std::nano>(handleTime).count() / iterations << (sink == 42 ? " " : "") << std::endl;
+}
+
+//concurrent transfers between two accounts, every snapshot sees the same total
+//(the descriptors of the multi updates are recycled, the pool does not grow with the number of updates)
+void testMultiUpdate()
+{
+    constexpr int NUM_WRITERS = 4;
+    constexpr int NUM_READERS = 2;
+    LockFree<Foo> left(1000);
+    LockFree<Foo> right(1000);
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> violations{0};
+    std::vector<std::thread> writers;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < NUM_WRITERS; ++t)
+    {
+        writers.emplace_back([&, t]() {
+            int amount = t % 2 == 0 ? 1 : -1;
+            for (int i = 0; i < 10000; ++i)
+            {
+                multiInvoke([&](Foo *a, Foo *b) { a->inc(-amount); b->inc(amount); return true; }, left, right);
+            }
+        });
+    }
+    for (int t = 0; t < NUM_READERS; ++t)
+    {
+        readers.emplace_back([&]() {
+            while (!done.load())
+            {
+                auto [l, r] = snapshot(left, right);
+                violations.fetch_add(l.read() + r.read() != 2000);
+            }
+        });
+    }
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+    done.store(true);
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+
+    check(violations.load() == 0, "multi update: snapshots see the conserved total");
+    check(left.readOnly()->read() == 1000 && right.readOnly()->read() == 1000, "multi update: final balances");
+    check(left.version() == NUM_WRITERS * 10000 && right.version() == NUM_WRITERS * 10000, "multi update: every update counted");
+    //one per writer and those helpers still reference (a helper references at most one per running update)
+    check(MultiUpdateDescriptor::numDescriptors() <= NUM_WRITERS + (NUM_WRITERS + NUM_READERS) * NUM_WRITERS,
+          "multi update: descriptor pool bounded by the concurrent updates");
+}
+
+//waiters run on the writer which committed the update, never on readers which help to complete a multi update
+void testUpdateWaiters()
+{
+    LockFree<Foo> left(0);
+    LockFree<Foo> right(0);
+    std::atomic<bool> done{false};
+    std::thread reader([&]() {
+        while (!done.load())
+        {
+            left.readOnly()->read(); //helps if it finds a descriptor
+        }
+    });
+
+    std::atomic<uint64_t> wrongThread{0};
+    std::atomic<uint64_t> woken{0};
+    std::thread writer([&]() {
+        auto writerId = std::this_thread::get_id();
+        for (int i = 0; i < 10000; ++i)
+        {
+            left.onUpdate(left.version(), [&](uint64_t) {
+                wrongThread.fetch_add(std::this_thread::get_id() != writerId);
+                woken.fetch_add(1);
+            });
+            multiInvoke([](Foo *a, Foo *b) { a->inc(1); b->inc(1); return true; }, left, right);
+        }
+    });
+    writer.join();
+    done.store(true);
+    reader.join();
+
+    check(woken.load() == 10000, "waiters: every waiter woken once");
+    check(wrongThread.load() == 0, "waiters: run on the committing writer");
+}
+
+//updates which change nothing publish nothing, concurrent inserts of the same key succeed once
+void testLockFreeMap()
+{
+    LockFreeMap<int, std::string> map(1); //all keys in one bucket
+    check(map.insert(1, "one") && map.insert(2, "two") && map.insert(3, "three"), "map: insert new keys");
+    auto version = map.version();
+    check(!map.insert(2, "zwei") && *map.find(2) == "two", "map: insert of an existing key keeps the value");
+    check(!map.erase(4), "map: erase of a missing key");
+    check(map.version() == version, "map: nothing published without a change");
+
+    check(map.erase(3), "map: erase the last entry of the bucket");
+    check(!map.find(3) && *map.find(1) == "one" && *map.find(2) == "two", "map: entries after erasing the last one");
+    check(map.erase(1), "map: erase an entry which is not the last one");
+    check(!map.find(1) && *map.find(2) == "two", "map: entries after erasing the first one");
+    check(map.version() == version + 2, "map: one version per change");
+
+    LockFreeMap<int, int> shared(16);
+    std::atomic<int> inserted{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            for (int key = 0; key < 1000; ++key)
+            {
+                inserted.fetch_add(shared.insert(key, t));
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    check(inserted.load() == 1000 && shared.version() == 1000, "map: every key inserted once by concurrent inserts");
+}
+
+struct AddFoo
+{
+    void operator()(Foo &result, const Foo &shard)
+    {
+        result.inc(shard.read());
+    }
+};
+
+//reads merge all updates completed before, unchanged shards reuse the cached merge
+void testShardedLockFree()
+{
+    ShardedLockFree<Foo, AddFoo> counter(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 1000; ++i)
+            {
+                counter.invoke(&Foo::inc, 1);
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    check(counter.read().read() == 8000, "sharded: read merges all shards");
+    auto merges = counter.numMerges();
+    check(counter.read().read() == 8000 && counter.numMerges() == merges, "sharded: unchanged shards read from the cache");
+    counter.invoke(&Foo::inc, 5);
+    check(counter.read().read() == 8005 && counter.numMerges() == merges + 1, "sharded: a changed shard merges again");
+
+    ShardedLockFree<Foo, AddFoo> uncached(2, Foo(), false);
+    uncached.invoke(&Foo::inc, 3);
+    check(uncached.read().read() == 3 && uncached.numMerges() == 0, "sharded: without cache every read merges");
+}
+
+//updates are applied in order, one copy for all pending updates, concurrent updates are not lost
+void testLazyLockFree()
+{
+    LazyLockFree<Foo> lazy(16, 73);
+    lazy.invoke(&Foo::inc, 1);
+    lazy.invoke(&Foo::write, 42);
+    lazy.invoke(&Foo::inc, 3);
+    check(lazy.version() == 0, "lazy: updates below the threshold are only logged");
+    check(lazy.readOnly()->read() == 45, "lazy: logged updates applied in order");
+    check(lazy.version() == 1, "lazy: one copy for all logged updates");
+    check(lazy.readOnly()->read() == 45 && lazy.version() == 1, "lazy: no copy without pending updates");
+
+    LazyLockFree<Foo> shared(8, 0);
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> decreased{0};
+    std::thread reader([&]() {
+        int last = 0;
+        while (!done.load())
+        {
+            int value = shared.readOnly()->read();
+            decreased.fetch_add(value < last);
+            last = value;
+        }
+    });
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t)
+    {
+        writers.emplace_back([&]() {
+            for (int i = 0; i < 1000; ++i)
+            {
+                shared.invoke(&Foo::inc, 1);
+            }
+        });
+    }
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+    done.store(true);
+    reader.join();
+    check(shared.readOnly()->read() == 4000, "lazy: concurrent updates all applied once");
+    check(decreased.load() == 0, "lazy: reads never go back");
+}
+
+//many objects share the hazard pointers of a domain, more of them can be held at the same time than the old fixed limit
+//and a limited domain reuses its hazard pointers instead of creating more
+void testHazardDomain()
+{
+    constexpr int NUM_OBJECTS = 2000;
+    HazardDomain domain;
+    std::vector<std::unique_ptr<LockFree<Foo>>> table;
+    for (int i = 0; i < NUM_OBJECTS; ++i)
+    {
+        table.emplace_back(new LockFree<Foo>(domain, i));
+    }
+    {
+        std::deque<LockFree<Foo>::ReaderHandle> readers; //one hazard pointer each
+        for (auto &entry : table)
+        {
+            readers.emplace_back(*entry);
+        }
+        std::thread([&]() {
+            for (auto &entry : table)
+            {
+                entry->invoke(&Foo::inc, 1);
+            }
+        }).join();
+
+        bool updated = true;
+        for (int i = 0; i < NUM_OBJECTS; ++i)
+        {
+            updated = updated && readers[i]->read() == i + 1;
+        }
+        check(updated, "domain: readers of all objects held at the same time see the updates");
+        check(domain.numHazardPointers() >= NUM_OBJECTS, "domain: hazard pointers created for all readers");
+    }
+
+    HazardDomain limited(std::pmr::new_delete_resource(), 16);
+    check(limited.getMaxHazardPointers() == 16, "domain: configured limit");
+    std::vector<std::unique_ptr<LockFree<Foo>>> small;
+    for (int i = 0; i < 100; ++i)
+    {
+        small.emplace_back(new LockFree<Foo>(limited, 0));
+    }
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t)
+    {
+        writers.emplace_back([&]() {
+            for (int i = 0; i < 100; ++i)
+            {
+                for (auto &entry : small)
+                {
+                    entry->invoke(&Foo::inc, 1);
+                }
+            }
+        });
+    }
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+    bool complete = true;
+    for (auto &entry : small)
+    {
+        complete = complete && entry->readOnly()->read() == 400;
+    }
+    check(complete, "domain: updates complete with limited hazard pointers");
+    check(limited.numHazardPointers() <= 16, "domain: limit not exceeded");
+}
+
+//few hash values, hence many keys share a leaf
+struct CollidingHash
+{
+    size_t operator()(int key) const
+    {
+        return key % 7;
+    }
+};
+
+//the persistent containers behave like std::map and std::vector, copies are not changed by later updates
+//(also with colliding hashes), and concurrent updates through LockFree are not lost
+void testPersistentContainers()
+{
+    std::mt19937 random(42);
+    PersistentMap<int, int> map;
+    PersistentMap<int, int, CollidingHash> colliding;
+    std::map<int, int> expectedMap;
+    PersistentVector<int> vector;
+    std::vector<int> expectedVector;
+    for (int i = 0; i < 20000; ++i)
+    {
+        int key = random() % 2000;
+        if (random() % 3 == 0)
+        {
+            bool erased = expectedMap.erase(key) == 1;
+            check(map.erase(key) == erased && colliding.erase(key) == erased, "persistent map: erase");
+        }
+        else
+        {
+            map.set(key, i);
+            colliding.set(key, i);
+            expectedMap[key] = i;
+        }
+
+        if (random() % 4 == 0 && !expectedVector.empty())
+        {
+            vector.pop_back();
+            expectedVector.pop_back();
+        }
+        else if (random() % 4 == 0 && !expectedVector.empty())
+        {
+            auto index = random() % expectedVector.size();
+            vector.set(index, i);
+            expectedVector[index] = i;
+        }
+        else
+        {
+            vector.push_back(i);
+            expectedVector.push_back(i);
+        }
+    }
+
+    bool equal = map.size() == expectedMap.size() && colliding.size() == expectedMap.size();
+    for (int key = 0; key < 2000; ++key)
+    {
+        auto iter = expectedMap.find(key);
+        bool found = iter != expectedMap.end();
+        equal = equal && map.contains(key) == found && colliding.contains(key) == found;
+        equal = equal && (!found || (*map.find(key) == iter->second && *colliding.find(key) == iter->second));
+    }
+    check(equal, "persistent map: same entries as std::map");
+    equal = vector.size() == expectedVector.size();
+    for (size_t i = 0; equal && i < expectedVector.size(); ++i)
+    {
+        equal = vector[i] == expectedVector[i];
+    }
+    check(equal, "persistent vector: same elements as std::vector");
+
+    auto mapCopy = map;
+    auto vectorCopy = vector;
+    auto key = expectedMap.begin()->first;
+    map.erase(key);
+    map.set(-1, -1);
+    vector.set(0, -1);
+    vector.push_back(-1);
+    check(*mapCopy.find(key) == expectedMap.begin()->second && !mapCopy.contains(-1) && mapCopy.size() == expectedMap.size(),
+          "persistent map: copy unchanged by updates");
+    check(vectorCopy[0] == expectedVector[0] && vectorCopy.size() == expectedVector.size(), "persistent vector: copy unchanged by updates");
+
+    LockFree<PersistentMap<int, int>> routes;
+    LockFree<PersistentVector<int>> log;
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t)
+    {
+        writers.emplace_back([&, t]() {
+            for (int i = 0; i < 1000; ++i)
+            {
+                routes.invoke([&](PersistentMap<int, int> *map) { map->set(t * 1000 + i, t); return true; });
+                log.invoke([&](PersistentVector<int> *vector) { vector->push_back(t); return true; });
+            }
+        });
+    }
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+    auto routesReader = routes.readOnly();
+    auto logReader = log.readOnly();
+    bool complete = routesReader->size() == 4000 && logReader->size() == 4000;
+    for (int i = 0; complete && i < 4000; ++i)
+    {
+        complete = *routesReader->find(i) == i / 1000;
+    }
+    check(complete, "persistent containers: concurrent updates through LockFree all applied");
+}
+
+//updates of several processes are not lost, slots of a process which died while reading are recovered
+void testSharedLockFree()
+{
+    const std::string name = "/universal_lockfree_test";
+    SharedLockFree<Foo>::unlink(name);
+    {
+        SharedLockFree<Foo> shared(name, 0);
+        std::vector<pid_t> children;
+        for (int c = 0; c < 2; ++c)
+        {
+            auto child = fork();
+            if (child == 0)
+            {
+                SharedLockFree<Foo> attached(name);
+                for (int i = 0; i < 1000; ++i)
+                {
+                    attached.invoke(&Foo::inc, 1);
+                }
+                _exit(0);
+            }
+            children.push_back(child);
+        }
+        for (int i = 0; i < 1000; ++i)
+        {
+            shared.invoke(&Foo::inc, 1);
+        }
+        bool exited = true;
+        for (auto child : children)
+        {
+            int status = 0;
+            exited = exited && waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+        check(exited, "shared: child processes exited");
+        check(shared.readOnly()->read() == 3000, "shared: updates of all processes applied");
+    }
+    SharedLockFree<Foo>::unlink(name);
+
+    //all slots are taken by a reader which dies without releasing them
+    SharedLockFree<Foo, 2>::unlink(name);
+    {
+        SharedLockFree<Foo, 2> shared(name, 7);
+        auto child = fork();
+        if (child == 0)
+        {
+            SharedLockFree<Foo, 2> attached(name);
+            auto first = attached.readOnly();
+            auto second = attached.readOnly();
+            _exit(first->read() == 7 && second->read() == 7 ? 0 : 1);
+        }
+        int status = 0;
+        check(waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0, "shared: reader process read");
+        shared.invoke(&Foo::inc, 1); //needs a slot of the dead reader
+        check(shared.readOnly()->read() == 8, "shared: slots of a dead process recovered");
+    }
+    SharedLockFree<Foo, 2>::unlink(name);
+}
+
+//writers switch to combining once a window of updates lost more than the switch cost and back without contention,
+//every writer gets the result of its own update in both modes
+void testAdaptiveLockFree()
+{
+    using Adaptive = AdaptiveLockFree<Foo>;
+    Adaptive counter(0);
+    counter.setSwitchCost(std::chrono::nanoseconds(-1)); //any window switches to COMBINE
+    bool results = true;
+    for (uint64_t i = 1; i <= Adaptive::WINDOW; ++i)
+    {
+        results = results && counter.invoke(&Foo::inc, 1) == int(i);
+    }
+    check(counter.getMode() == Adaptive::COMBINE, "adaptive: combines if updates lose more than the switch cost");
+    for (uint64_t i = Adaptive::WINDOW + 1; i <= 2 * Adaptive::WINDOW; ++i)
+    {
+        results = results && counter.invoke(&Foo::inc, 1) == int(i);
+    }
+    check(counter.getMode() == Adaptive::COPY, "adaptive: copies again if batches are single updates");
+    check(results, "adaptive: results of sequential updates");
+
+    counter.setSwitchCost(std::chrono::nanoseconds(0));
+    std::vector<std::vector<int>> values(4);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t)
+    {
+        writers.emplace_back([&, t]() {
+            for (int i = 0; i < 1000; ++i)
+            {
+                values[t].push_back(counter.invoke(&Foo::inc, 1));
+            }
+        });
+    }
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+    std::vector<bool> seen(4 * 1000 + 1, false);
+    bool unique = true;
+    for (auto &threadValues : values)
+    {
+        for (auto value : threadValues)
+        {
+            value -= 2 * Adaptive::WINDOW;
+            unique = unique && value > 0 && value <= 4000 && !seen[value];
+            seen[value] = unique;
+        }
+    }
+    check(unique && counter.readOnly()->read() == int(2 * Adaptive::WINDOW) + 4000, "adaptive: each concurrent update applied once with its own result");
+}
+
+//counts its instances, i.e. the versions of an object which are constructed
+struct Counted
+{
+    static std::atomic<int> s_numInstances;
+
+    Counted(int value = 0) : value(value)
+    {
+        s_numInstances.fetch_add(1);
+    }
+
+    Counted(const Counted &other) : value(other.value)
+    {
+        s_numInstances.fetch_add(1);
+    }
+
+    ~Counted()
+    {
+        s_numInstances.fetch_sub(1);
+    }
+
+    int inc(int x)
+    {
+        return value += x;
+    }
+
+    int value;
+};
+
+std::atomic<int> Counted::s_numInstances{0};
+
+//no update is lost with more threads than slots, at most capacity() versions exist and all are destroyed with the object
+void testFixedLockFree()
+{
+    {
+        FixedLockFree<Counted, 2> fixed(0);
+        std::atomic<bool> done{false};
+        std::atomic<uint64_t> decreased{0};
+        std::atomic<int> maxInstances{0};
+        std::thread reader([&]() {
+            int last = 0;
+            while (!done.load())
+            {
+                int value = fixed.readOnly()->value;
+                decreased.fetch_add(value < last);
+                last = value;
+                int instances = Counted::s_numInstances.load();
+                if (instances > maxInstances.load())
+                {
+                    maxInstances.store(instances);
+                }
+            }
+        });
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t)
+        {
+            writers.emplace_back([&]() {
+                for (int i = 0; i < 1000; ++i)
+                {
+                    fixed.invoke(&Counted::inc, 1);
+                }
+            });
+        }
+        for (auto &writer : writers)
+        {
+            writer.join();
+        }
+        done.store(true);
+        reader.join();
+        check(fixed.readOnly()->value == 4000, "fixed: updates of more threads than slots applied");
+        check(decreased.load() == 0, "fixed: reads never go back");
+        check(maxInstances.load() <= int(fixed.capacity()), "fixed: versions within the capacity");
+    }
+    check(Counted::s_numInstances.load() == 0, "fixed: versions destroyed with the object");
+}
+
+//threads return their state when they exit, a scan afterwards unlinks their hazard pointers (also those owned for reading),
+//hence the list walked by scans does not grow with the number of threads which ever used the domain
+void testThreadExit()
+{
+    HazardDomain domain;
+    LockFree<Foo> object(domain, 0);
+    auto useObject = [&]() {
+        auto reader = object.reader(); //owned hazard pointer
+        auto proxy = object.readOnly();
+        object.invoke(&Foo::inc, 1 + proxy->read() - reader->read());
+    };
+
+    //more threads than states, one after another
+    for (int t = 0; t < 200; ++t)
+    {
+        std::thread(useObject).join();
+    }
+    domain.scan();
+    auto sequential = domain.numHazardPointers();
+    check(object.readOnly()->read() == 200, "thread exit: updates of exited threads");
+    check(sequential <= 8, "thread exit: hazard pointers of sequential threads reused");
+
+    //threads at the same time, each holding hazard pointers until all of them hold some
+    std::atomic<int> holding{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 32; ++t)
+    {
+        threads.emplace_back([&]() {
+            auto reader = object.reader();
+            auto proxy = object.readOnly();
+            holding.fetch_add(1);
+            while (holding.load() < 32)
+            {
+                std::this_thread::yield();
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    auto concurrent = domain.numHazardPointers();
+    domain.scan();
+    check(concurrent >= 64, "thread exit: hazard pointers of concurrent threads listed");
+    check(domain.numHazardPointers() <= 8, "thread exit: hazard pointers of exited threads unlinked by the next scan");
+}
+
+std::atomic<uint64_t> g_scanSteps{0};
+
+void countScanStep(std::chrono::nanoseconds)
+{
+    g_scanSteps.fetch_add(1);
+}
+
+//with incremental scans every retire does a bounded step of the scan, the retired versions are still reclaimed
+//while writers update (they do not pile up) and all of them once the object is destroyed
+void testIncrementalScan()
+{
+    HazardDomain domain;
+    domain.setIncrementalScan(16);
+    domain.observeScans(countScanStep);
+    {
+        LockFree<Counted> object(domain, 0);
+        std::atomic<bool> done{false};
+        std::atomic<int> maxInstances{0};
+        std::thread reader([&]() {
+            while (!done.load())
+            {
+                auto proxy = object.readOnly(); //keeps a version alive while scanning
+                int instances = Counted::s_numInstances.load();
+                if (instances > maxInstances.load())
+                {
+                    maxInstances.store(instances);
+                }
+            }
+        });
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t)
+        {
+            writers.emplace_back([&]() {
+                for (int i = 0; i < 2500; ++i)
+                {
+                    object.invoke(&Counted::inc, 1);
+                }
+            });
+        }
+        for (auto &writer : writers)
+        {
+            writer.join();
+        }
+        done.store(true);
+        reader.join();
+        check(object.readOnly()->value == 10000, "incremental scan: updates applied");
+        check(g_scanSteps.load() >= 10000, "incremental scan: a step per retire");
+        check(maxInstances.load() <= 64, "incremental scan: retired versions reclaimed while updating");
+    }
+    domain.observeScans(nullptr);
+    check(Counted::s_numInstances.load() == 0, "incremental scan: all versions reclaimed with the object");
+}
+
+//readers holding old versions throttle the writers: tryInvoke fails and invoke waits until the readers release them
+void testBackpressure()
+{
+    LockFree<Foo> counter(0);
+    counter.setMaxUnreclaimed(2);
+    std::unique_ptr<LockFree<Foo>::ReaderHandle> first(new LockFree<Foo>::ReaderHandle(counter));
+    counter.invoke(&Foo::inc, 1);
+    std::unique_ptr<LockFree<Foo>::ReaderHandle> second(new LockFree<Foo>::ReaderHandle(counter));
+    counter.invoke(&Foo::inc, 1);
+    check(counter.unreclaimed() == 2 && counter.unreclaimedBytes() == 2 * sizeof(Foo), "backpressure: versions kept by readers");
+    check(!counter.tryInvoke(&Foo::inc, 1).has_value() && counter.readOnly()->read() == 2, "backpressure: tryInvoke fails at the limit");
+
+    std::atomic<bool> updated{false};
+    std::thread writer([&]() {
+        counter.invoke(&Foo::inc, 1);
+        updated.store(true);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    check(!updated.load(), "backpressure: invoke waits at the limit");
+    first.reset();
+    second.reset();
+    writer.join();
+    check(counter.readOnly()->read() == 3 && counter.unreclaimed() <= 2, "backpressure: invoke continues once the readers released");
+}
+
+#ifdef LOCKFREE_TRACE
+//dump while threads record, every dumped event is complete (an event of the update or the read)
+void testTraceDump()
+{
+    LockFree<Foo> object(0);
+    std::atomic<bool> done{false};
+    std::thread writer([&]() {
+        while (!done.load())
+        {
+            object.invoke(&Foo::inc, 1);
+            object.readOnly()->read();
+        }
+    });
+    bool complete = true;
+    for (int i = 0; i < 100; ++i)
+    {
+        std::ostringstream out;
+        TraceBuffer::dump(out, 64);
+        std::istringstream in(out.str());
+        std::string line;
+        while (std::getline(in, line))
+        {
+            std::istringstream fields(line);
+            std::string first, event;
+            uint64_t a, b;
+            complete = complete && fields >> first >> event && (first == "thread" || (fields >> a >> b && !event.empty()));
+        }
+    }
+    done.store(true);
+    writer.join();
+    check(complete, "trace: dump of buffers being recorded");
+}
+#endif
+
+//objects with default constructed arena allocators share one arena, a private one is only used by its object
+void testSharedArenas()
+{
+    LockFree<Foo, ArenaAllocator> a(1);
+    LockFree<Foo, ArenaAllocator> b(2);
+    LockFree<Foo, ArenaAllocator> hot(std::allocator_arg, ArenaAllocator(ArenaAllocator::DEFAULT_RESERVED_SIZE), 3);
+    check(a.getAllocator().resource == b.getAllocator().resource, "arena: default allocators share the arena");
+    check(hot.getAllocator().resource != a.getAllocator().resource, "arena: private arena");
+
+    LockFree<Foo, HugePageAllocator> c(1);
+    LockFree<Foo, HugePageAllocator> d(2);
+    LockFree<Foo, HugePageAllocator> big(std::allocator_arg, HugePageAllocator(HugePageResource::HUGE_PAGE_SIZE), 3);
+    check(c.getAllocator().resource == d.getAllocator().resource, "huge pages: default allocators share the region");
+    check(big.getAllocator().resource != c.getAllocator().resource, "huge pages: private region");
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t)
+    {
+        writers.emplace_back([&]() {
+            for (int i = 0; i < 1000; ++i)
+            {
+                a.invoke(&Foo::inc, 1);
+                b.invoke(&Foo::inc, 1);
+                c.invoke(&Foo::inc, 1);
+                d.invoke(&Foo::inc, 1);
+            }
+        });
+    }
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+    check(a.readOnly()->read() == 4001 && b.readOnly()->read() == 4002 && c.readOnly()->read() == 4001 &&
+              d.readOnly()->read() == 4002,
+          "arena: updates of objects sharing an arena");
+}
+
+//updates per microsecond of concurrent writers on a single shard and on one shard per writer
+void benchmarkSharded(int iterations = 100000)
+{
+    for (uint32_t numWriters : {1u, 2u, 4u})
+    {
+        for (uint32_t numShards : {1u, numWriters})
+        {
+            ShardedLockFree<Foo, AddFoo> counter(numShards);
+            std::vector<std::thread> writers;
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t t = 0; t < numWriters; ++t)
+            {
+                writers.emplace_back([&]() {
+                    for (int i = 0; i < iterations; ++i)
+                    {
+                        counter.invoke(&Foo::inc, 1);
+                    }
+                });
+            }
+            for (auto &writer : writers)
+            {
+                writer.join();
+            }
+            auto duration = std::chrono::steady_clock::now() - start;
+            check(counter.read().read() == static_cast<int>(numWriters) * iterations, "sharded: no update lost");
+            std::cout << "sharded writers " << numWriters << " shards " << numShards << " updates/us "
+                      << numWriters * iterations / std::chrono::duration<double, std::micro>(duration).count() << std::endl;
+            if (numShards == numWriters)
+            {
+                break;
+            }
+        }
+    }
+}
+
+//snapshots with the object version, a torn header record falls back to the previous snapshot
+void testSnapshotFile()
+{
+    const char *path = "/tmp/universal_lockfree_test.snapshot";
+    unlink(path);
+    auto serialize = [](const Foo &foo, char *buffer, size_t capacity) {
+        if (capacity >= sizeof(int))
+        {
+            std::memcpy(buffer, &foo.value, sizeof(int));
+        }
+        return sizeof(int);
+    };
+    int value = 0;
+    auto deserialize = [&](const char *buffer, size_t size) {
+        check(size == sizeof(int), "snapshot file: size of the snapshot");
+        std::memcpy(&value, buffer, sizeof(int));
+    };
+
+    LockFree<Foo> config(1);
+    {
+        SnapshotFile<Foo> file(config, path, serialize);
+        check(file.persistedSequence() == 0 && !file.persistedVersion(), "snapshot file: nothing persisted yet");
+        config.invoke(&Foo::inc, 41);
+        auto first = file.snapshot();
+        check(file.wait(first) && file.persistedSequence() == first, "snapshot file: first snapshot persisted");
+        check(file.persistedVersion() == std::optional<uint64_t>(1), "snapshot file: first snapshot version");
+        config.invoke(&Foo::inc, 1);
+        check(file.wait(file.snapshot()) && file.persistedVersion() == std::optional<uint64_t>(2), "snapshot file: second snapshot version");
+    }
+    auto version = SnapshotFile<Foo>::load(path, deserialize);
+    check(version == std::optional<uint64_t>(2) && value == 43, "snapshot file: load the last snapshot");
+
+    //a crash while the header record of the second snapshot was written: the new version is written, the checksum is not
+    {
+        auto fd = open(path, O_RDWR);
+        uint64_t records[2][5];
+        check(pread(fd, records, sizeof(records), sizeof(uint64_t)) == sizeof(records), "snapshot file: read the header");
+        auto index = records[0][0] > records[1][0] ? 0 : 1;
+        records[index][1] = 3;
+        check(pwrite(fd, records, sizeof(records), sizeof(uint64_t)) == sizeof(records), "snapshot file: tear the header");
+        close(fd);
+    }
+    version = SnapshotFile<Foo>::load(path, deserialize);
+    check(version == std::optional<uint64_t>(1) && value == 42, "snapshot file: torn record falls back to the previous snapshot");
+    {
+        SnapshotFile<Foo> file(config, path, serialize);
+        check(file.persistedSequence() == 1 && file.persistedVersion() == std::optional<uint64_t>(1), "snapshot file: continue after the valid snapshot");
+    }
+    unlink(path);
+}
+
+//updates and waiting from coroutines, resumed through a task queue
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object()
+        {
+            return {};
+        }
+        std::suspend_never initial_suspend()
+        {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+        void return_void()
+        {
+        }
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+};
+
+using Executor = std::function<void(std::function<void()>)>;
+
+Task coIncrement(LockFree<Foo> &counter, Executor executor, int amount, int &result)
+{
+    result = co_await coInvoke(counter, executor, &Foo::inc, amount);
+}
+
+Task coWait(LockFree<Foo> &counter, Executor executor, uint64_t version, uint64_t &newVersion)
+{
+    newVersion = co_await waitForUpdate(counter, version, executor);
+}
+
+void testCoroutines()
+{
+    std::deque<std::function<void()>> tasks;
+    Executor executor = [&](std::function<void()> task) { tasks.push_back(std::move(task)); };
+    auto runTasks = [&]() {
+        while (!tasks.empty())
+        {
+            auto task = std::move(tasks.front());
+            tasks.pop_front();
+            task();
+        }
+    };
+
+    LockFree<Foo> counter(0);
+    uint64_t newVersion = 0;
+    coWait(counter, executor, counter.version(), newVersion); //suspended until the update
+
+    int result = 0;
+    coIncrement(counter, executor, 5, result); //completes without suspending
+    check(result == 5, "coroutines: coInvoke returns the result of f with its parameter");
+    check(newVersion == 0, "coroutines: waiter resumed by the executor, not by the writer");
+    runTasks();
+    check(newVersion == 1, "coroutines: waitForUpdate returns the new version");
+
+    //a reader keeps the replaced version, with the limit the attempts fail and the coroutine is rescheduled
+    counter.setMaxUnreclaimed(1);
+    {
+        auto reader = counter.reader();
+        counter.invoke(&Foo::inc, 1);
+        result = 0;
+        coIncrement(counter, executor, 3, result);
+        for (int i = 0; i < 10; ++i)
+        {
+            auto task = std::move(tasks.front());
+            tasks.pop_front();
+            task();
+        }
+        check(result == 0 && tasks.size() == 1, "coroutines: coInvoke rescheduled while updates fail");
+    }
+    runTasks();
+    check(result == 9 && counter.version() == 3, "coroutines: coInvoke resumed after the update succeeded");
+
+    uint64_t current = 0;
+    coWait(counter, executor, 0, current); //already changed
+    check(current == 3 && tasks.empty(), "coroutines: waitForUpdate ready if the version differs");
+}
+#endif
+
 int main(int argc, char **argv)
 {
+    testMultiUpdate();
+    testUpdateWaiters();
+    testSnapshotFile();
+    testLockFreeMap();
+    testShardedLockFree();
+    testLazyLockFree();
+    testHazardDomain();
+    testPersistentContainers();
+    testSharedLockFree();
+    testAdaptiveLockFree();
+    testFixedLockFree();
+    testThreadExit();
+    testIncrementalScan();
+    testBackpressure();
+    testSharedArenas();
+#ifdef LOCKFREE_TRACE
+    testTraceDump();
+#endif
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+    testCoroutines();
+#else
+    std::cout << "coroutines not checked (needs C++20)" << std::endl;
+#endif
+
+    //--checks: without the benchmarks
+    if (argc > 1 && std::string(argv[1]) == "--checks")
+    {
+        std::cout << (g_failures == 0 ? "all checks passed" : "checks failed") << std::endl;
+        return g_failures == 0 ? 0 : 1;
+    }
+
     {
         Bar bar;
         test(bar, 1 << 20, 2, 3);
@@ -84,6 +1228,17 @@ int main(int argc, char **argv)
         lfBar->print();
     }
 
+    testLatency();
+    testLatency(100000, 16);
+    testReaderHandle();
+    benchmarkSharded();
+
+    //the same load for every strategy
+    benchmarkPolicies<Bar>([](auto &object) { object.invoke(&Bar::work, 1); },
+                           [](auto &object) { return object.readOnly()->a.load(std::memory_order_relaxed); },
+                           100000, 2, 2);
+
     Allocator::print();
-    return 0;
+    std::cout << (g_failures == 0 ? "all checks passed" : "checks failed") << std::endl;
+    return g_failures == 0 ? 0 : 1;
 }